@@ -0,0 +1,272 @@
+/*
+ * DSP load of running ALSA PCM streams read from procfs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <glob.h>
+
+#include "globals.h"
+#include "glitch.h"
+#include "alsa_load.h"
+
+#define MAX_ALSA_STREAMS 8
+#define STATUS_SIZE 1024
+
+/*
+ * The status of a running substream looks like
+ *
+ *   state: RUNNING
+ *   owner_pid   : 1234
+ *   trigger_time: 5.123456789
+ *   tstamp      : 9.123456789
+ *   delay       : 448
+ *   avail       : 64
+ *   avail_max   : 160
+ *   -----
+ *   hw_ptr      : 429120
+ *   appl_ptr    : 429568
+ *
+ * The application is woken once avail reaches a period and then fills
+ * or drains it, so avail_max - period_size is how far it ran behind the
+ * hardware; the kernel resets avail_max on every status read. Spread
+ * over the rest of the buffer, that is the fraction of the headroom the
+ * period took: the DSP load.
+ */
+typedef struct alsa_stream {
+	int fd;
+	char name[64];          /* cardN/pcmMp/subK */
+	int owner_pid;
+	unsigned long rate;
+	unsigned long period_size;
+	unsigned long buffer_size;
+	char trigger_time[32];  /* changes when the stream restarts */
+	int in_xrun;
+} alsa_stream_t;
+
+static alsa_stream_t streams[MAX_ALSA_STREAMS];
+static int nstreams = 0;
+static unsigned int xrun_count = 0;
+
+/* the value of a "key: value" line, NULL if there is none */
+static const char *field(const char *text, const char *key) {
+	size_t len = strlen(key);
+	const char *p;
+
+	for (p = text; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+		if (strncmp(p, key, len) != 0)
+			continue;
+		p += len;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p != ':')
+			continue;
+		p++;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		return p;
+	}
+	return NULL;
+}
+
+static unsigned long field_ul(const char *text, const char *key) {
+	const char *v = field(text, key);
+
+	return v ? strtoul(v, NULL, 10) : 0;
+}
+
+static int is_running(const char *status) {
+	const char *v = field(status, "state");
+
+	return v && (strncmp(v, "RUNNING", 7) == 0 || strncmp(v, "XRUN", 4) == 0);
+}
+
+static void copy_field(const char *text, const char *key, char *dst, size_t size) {
+	const char *v = field(text, key);
+	size_t n = v ? strcspn(v, "\n") : 0;
+
+	if (n >= size)
+		n = size - 1;
+	memcpy(dst, v ? v : "", n);
+	dst[n] = '\0';
+}
+
+static int add_stream(const char *status_path) {
+	alsa_stream_t *s = &streams[nstreams];
+	char path[PATH_MAX], text[STATUS_SIZE];
+	const char *dir;
+	size_t len;
+
+	if (read_file_to(status_path, 0, 1, text, sizeof(text)) != 0
+			|| !is_running(text))
+		return 0;
+
+	/* hw_params lives next to status */
+	len = strlen(status_path) - strlen("status");
+	snprintf(path, sizeof(path), "%.*shw_params", (int)len, status_path);
+	if (read_file_to(path, 0, 1, text, sizeof(text)) != 0)
+		return 0;
+	s->rate = field_ul(text, "rate");
+	s->period_size = field_ul(text, "period_size");
+	s->buffer_size = field_ul(text, "buffer_size");
+	if (!s->rate || !s->period_size || s->buffer_size <= s->period_size)
+		return 0;
+
+	if ((s->fd = open(status_path, O_RDONLY)) < 0)
+		return 0;
+	if (read_file_to(NULL, s->fd, 0, text, sizeof(text)) != 0) {
+		close(s->fd);
+		return 0;
+	}
+	s->owner_pid = field_ul(text, "owner_pid");
+	copy_field(text, "trigger_time", s->trigger_time, sizeof(s->trigger_time));
+	s->in_xrun = 0;
+
+	/* the name is the part below asound/ */
+	if ((dir = strstr(status_path, "asound/")) != NULL)
+		dir += strlen("asound/");
+	else
+		dir = status_path;
+	snprintf(s->name, sizeof(s->name), "%.*s",
+			(int)(status_path + len - 1 - dir), dir);
+	pprintf(2, "Reading the load of %s: %lu frames per period at %lu Hz, "
+			"%lu frames buffered, owner %d\n", s->name, s->period_size,
+			s->rate, s->buffer_size, s->owner_pid);
+	nstreams++;
+	return 1;
+}
+
+int alsa_open(void) {
+	char pattern[PATH_MAX];
+	glob_t g;
+	size_t i;
+
+	alsa_close();
+	snprintf(pattern, sizeof(pattern), "%s/asound/card*/pcm*/sub*/status",
+			procfs_root);
+	if (glob(pattern, 0, NULL, &g) != 0)
+		return 0;
+	/* playback first: the glob sorts pcmNc before pcmNp */
+	for (i = 0; i < g.gl_pathc && nstreams < MAX_ALSA_STREAMS; i++)
+		if (strstr(g.gl_pathv[i], "p/sub"))
+			add_stream(g.gl_pathv[i]);
+	for (i = 0; i < g.gl_pathc && nstreams < MAX_ALSA_STREAMS; i++)
+		if (strstr(g.gl_pathv[i], "c/sub"))
+			add_stream(g.gl_pathv[i]);
+	globfree(&g);
+	return nstreams;
+}
+
+int alsa_is_open(void) {
+	return nstreams > 0;
+}
+
+void alsa_close(void) {
+	int i;
+
+	for (i = 0; i < nstreams; i++)
+		close(streams[i].fd);
+	nstreams = 0;
+}
+
+static void xrun(alsa_stream_t *s, const char *what) {
+	xrun_count++;
+	glitch_record(monotonic_ns());
+	pprintf(3, "%s: %s\n", s->name, what);
+}
+
+float alsa_poll(void) {
+	char text[STATUS_SIZE], trigger[32];
+	float load, max_load = 0;
+	int i, running = 0;
+
+	for (i = 0; i < nstreams; i++) {
+		alsa_stream_t *s = &streams[i];
+		unsigned long avail;
+		const char *state;
+
+		if (read_file_to(NULL, s->fd, 0, text, sizeof(text)) != 0)
+			continue;
+		state = field(text, "state");
+		if (state && strncmp(state, "XRUN", 4) == 0) {
+			if (!s->in_xrun)
+				xrun(s, "xrun");
+			s->in_xrun = 1;
+			running++;
+			continue;
+		}
+		s->in_xrun = 0;
+		if (!is_running(text))
+			continue;
+		running++;
+
+		/* a recovered xrun restarts the stream between two reads */
+		copy_field(text, "trigger_time", trigger, sizeof(trigger));
+		if (strcmp(trigger, s->trigger_time) != 0) {
+			xrun(s, "restarted");
+			strcpy(s->trigger_time, trigger);
+		}
+
+		avail = field_ul(text, "avail_max");
+		if (field_ul(text, "avail") > avail)
+			avail = field_ul(text, "avail");
+		if (avail <= s->period_size)
+			load = 0;
+		else if (avail >= s->buffer_size)
+			load = 100;
+		else
+			load = 100.0 * (avail - s->period_size)
+				/ (s->buffer_size - s->period_size);
+		pprintf(4, "%s: avail max %lu of %lu, load %.1f%%\n",
+				s->name, avail, s->buffer_size, load);
+		if (load > max_load)
+			max_load = load;
+	}
+
+	if (nstreams && !running) {
+		pprintf(2, "The ALSA streams stopped\n");
+		alsa_close();
+	}
+	return max_load;
+}
+
+unsigned int alsa_period_usecs(void) {
+	unsigned int usecs, min = 0;
+	int i;
+
+	for (i = 0; i < nstreams; i++) {
+		usecs = streams[i].period_size * 1000000ULL / streams[i].rate;
+		if (!min || usecs < min)
+			min = usecs;
+	}
+	return min;
+}
+
+unsigned int alsa_xruns(void) {
+	return xrun_count;
+}
+
+int alsa_owner_pid(void) {
+	return nstreams ? streams[0].owner_pid : 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * DSP load of running ALSA PCM streams read from procfs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef ALSA_LOAD_H
+#define ALSA_LOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Find the running substreams under procfs_root/asound and open their
+ * status files.
+ * @return the number of substreams found
+ */
+extern int alsa_open(void);
+
+extern int alsa_is_open(void);
+
+extern void alsa_close(void);
+
+/**
+ * Read the status of the open substreams. Closes them all once none of
+ * them runs any more, alsa_open() looks for new ones.
+ * @return the load in percent of the most loaded substream
+ */
+extern float alsa_poll(void);
+
+/* the shortest period of the open substreams, 0 if none */
+extern unsigned int alsa_period_usecs(void);
+
+/* underruns and overruns seen since the start */
+extern unsigned int alsa_xruns(void);
+
+/* the process owning the first open substream, 0 if none */
+extern int alsa_owner_pid(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALSA_LOAD_H */
@@ -0,0 +1,200 @@
+/*
+ * Tracking the cpus that handle the sound card interrupts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "audio_irq.h"
+
+#define MAX_AUDIO_IRQS 16
+#define MAX_IRQ_CPUS 1024
+#define IRQ_LINE 16384
+
+typedef struct audio_irq {
+	int irq;
+	cpu_set_t affinity;
+	unsigned long long last[MAX_IRQ_CPUS]; /* by cpu id */
+	unsigned long long total;
+} audio_irq_t;
+
+unsigned int irq_floor_pct = 0;
+
+static audio_irq_t irqs[MAX_AUDIO_IRQS];
+static int nirqs = 0;
+static int ncols = 0;   /* cpu columns in /proc/interrupts */
+static int col_cpu[MAX_IRQ_CPUS]; /* the cpu of each column */
+static char line[IRQ_LINE];
+
+static FILE *open_interrupts(void) {
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/interrupts", procfs_root);
+	return fopen(path, "r");
+}
+
+static void read_affinity(audio_irq_t *a) {
+	char path[PATH_MAX], list[256], *tok, *save;
+	int lo, hi, c;
+
+	CPU_ZERO(&a->affinity);
+	snprintf(path, sizeof(path), "%s/irq/%d/effective_affinity_list",
+			procfs_root, a->irq);
+	if (read_file_to(path, 0, 1, list, sizeof(list)) != 0) {
+		snprintf(path, sizeof(path), "%s/irq/%d/smp_affinity_list",
+				procfs_root, a->irq);
+		if (read_file_to(path, 0, 1, list, sizeof(list)) != 0)
+			return;
+	}
+	for (tok = strtok_r(list, ",\n", &save); tok; tok = strtok_r(NULL, ",\n", &save)) {
+		if (sscanf(tok, "%d-%d", &lo, &hi) != 2)
+			hi = lo = atoi(tok);
+		for (c = lo; c <= hi && c < CPU_SETSIZE; c++)
+			CPU_SET(c, &a->affinity);
+	}
+}
+
+static int is_audio(const char *names) {
+	return strstr(names, "snd_") != NULL || strstr(names, "xhci") != NULL;
+}
+
+/*
+ * The header names one column per online cpu: "CPU0 CPU1 CPU3 ...".
+ * With cpus offline the column is not the cpu id.
+ */
+static void parse_header(const char *l) {
+	const char *p;
+
+	ncols = 0;
+	for (p = strstr(l, "CPU"); p && ncols < MAX_IRQ_CPUS; p = strstr(p + 3, "CPU"))
+		col_cpu[ncols++] = atoi(p + 3);
+}
+
+/*
+ * Parse one line: "N: count count ... chip details names", filling
+ * counts with the counters by cpu id. Returns the irq or -1.
+ */
+static int parse_line(char *l, unsigned long long *counts, char **rest) {
+	char *p = l, *end;
+	int irq, c;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	if (!isdigit((unsigned char)*p))
+		return -1;
+	irq = strtol(p, &end, 10);
+	if (*end != ':')
+		return -1;
+	p = end + 1;
+	for (c = 0; c < ncols; c++) {
+		unsigned long long v = strtoull(p, &end, 10);
+
+		if (end == p)
+			break;
+		if (col_cpu[c] >= 0 && col_cpu[c] < MAX_IRQ_CPUS)
+			counts[col_cpu[c]] = v;
+		p = end;
+	}
+	*rest = p;
+	return irq;
+}
+
+int audio_irq_scan(void) {
+	unsigned long long counts[MAX_IRQ_CPUS];
+	FILE *f;
+	char *rest;
+	int irq;
+
+	nirqs = 0;
+	if ((f = open_interrupts()) == NULL)
+		return 0;
+
+	if (fgets(line, sizeof(line), f))
+		parse_header(line);
+
+	while (nirqs < MAX_AUDIO_IRQS && fgets(line, sizeof(line), f)) {
+		memset(counts, 0, sizeof(counts));
+		if ((irq = parse_line(line, counts, &rest)) < 0 || !is_audio(rest))
+			continue;
+		irqs[nirqs].irq = irq;
+		memcpy(irqs[nirqs].last, counts, sizeof(counts));
+		irqs[nirqs].total = 0;
+		read_affinity(&irqs[nirqs]);
+		rest[strcspn(rest, "\n")] = '\0';
+		pprintf(2, "Audio interrupt %d:%s\n", irq, rest);
+		nirqs++;
+	}
+	fclose(f);
+	return nirqs;
+}
+
+double audio_irq_update(cpu_set_t *cpus, double seconds) {
+	unsigned long long counts[MAX_IRQ_CPUS], delta = 0;
+	FILE *f;
+	char *rest;
+	int irq, i, c, cpu;
+
+	CPU_ZERO(cpus);
+	if (!nirqs || (f = open_interrupts()) == NULL)
+		return 0;
+
+	if (!fgets(line, sizeof(line), f)) {
+		fclose(f);
+		return 0;
+	}
+	/* cpus may have gone on- or offline since the last read */
+	parse_header(line);
+	while (fgets(line, sizeof(line), f)) {
+		memset(counts, 0, sizeof(counts));
+		if ((irq = parse_line(line, counts, &rest)) < 0)
+			continue;
+		for (i = 0; i < nirqs; i++) {
+			audio_irq_t *a = &irqs[i];
+
+			if (a->irq != irq)
+				continue;
+			for (c = 0; c < ncols; c++) {
+				if ((cpu = col_cpu[c]) < 0 || cpu >= MAX_IRQ_CPUS)
+					continue;
+				if (counts[cpu] > a->last[cpu]) {
+					delta += counts[cpu] - a->last[cpu];
+					a->total += counts[cpu] - a->last[cpu];
+					if (CPU_ISSET(cpu, &a->affinity) || !CPU_COUNT(&a->affinity))
+						CPU_SET(cpu, cpus);
+				}
+				a->last[cpu] = counts[cpu];
+			}
+		}
+	}
+	fclose(f);
+	return seconds > 0 ? delta / seconds : 0;
+}
+
+void audio_irq_report(int level) {
+	int i;
+
+	for (i = 0; i < nirqs; i++)
+		pprintf(level, "  audio interrupt %d: %llu\n", irqs[i].irq,
+		    irqs[i].total);
+}
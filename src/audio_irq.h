@@ -0,0 +1,51 @@
+/*
+ * Tracking the cpus that handle the sound card interrupts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef AUDIO_IRQ_H
+#define AUDIO_IRQ_H
+
+#include <sched.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern unsigned int irq_floor_pct; /* of the max speed, 0 - off */
+
+/**
+ * Find the interrupt lines of sound cards (snd_*) and USB host
+ * controllers (xhci_hcd) that may carry a USB audio interface.
+ * @return the number of lines found
+ */
+extern int audio_irq_scan(void);
+
+/**
+ * Count the audio interrupts since the last call.
+ * @param cpus receives the cpus in the lines' effective affinity that
+ *   handled any of them
+ * @return interrupts per second over all lines
+ */
+extern double audio_irq_update(cpu_set_t *cpus, double seconds);
+
+extern void audio_irq_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIO_IRQ_H */
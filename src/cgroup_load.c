@@ -0,0 +1,344 @@
+/*
+ * CPU load of the audio workload measured through its cgroup v2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include "globals.h"
+#include "cgroup_load.h"
+
+#define CGROUP_TREE "/sys/fs/cgroup"
+#define MAX_CGROUP_THREADS 1024
+#define MAX_CGROUP_DEPTH 8
+/* the least time between two walks over the threads */
+#define THREAD_WALK_NS 100000000LL
+
+/* the cpu time of a thread of the cgroup at the last sample */
+typedef struct thread_time {
+	int tid;
+	unsigned long long ticks;
+} thread_time_t;
+
+const char *cgroup_arg = NULL;
+const char *cgroupfs_root = CGROUP_TREE;
+
+static char dir[PATH_MAX / 2];
+static int stat_fd = -1;
+static cpu_set_t cpuset;
+static int ncpuset = 0;
+static unsigned long long last_usec = 0;
+static long long last_ns = 0;
+static int have_load = 0;
+static float loads[CPU_SETSIZE];      /* fraction of each cpu */
+static double ran_ticks[CPU_SETSIZE]; /* of the threads since the last walk */
+static double shares[CPU_SETSIZE];    /* of the usage, from the last walk */
+static int have_shares = 0;
+static long long walk_ns = 0;
+static thread_time_t threads[2][MAX_CGROUP_THREADS];
+static int nthreads[2] = {0, 0};
+static int cur_threads = 0;
+
+const char *cgroup_root(void) {
+	static char hybrid[PATH_MAX / 2];
+	char path[PATH_MAX];
+
+	/* the v1 controllers own the top with the hybrid layout */
+	snprintf(path, sizeof(path), "%s/cgroup.controllers", cgroupfs_root);
+	if (access(path, F_OK) == 0)
+		return cgroupfs_root;
+	snprintf(hybrid, sizeof(hybrid), "%s/unified", cgroupfs_root);
+	snprintf(path, sizeof(path), "%s/cgroup.controllers", hybrid);
+	if (access(path, F_OK) == 0)
+		return hybrid;
+	return cgroupfs_root;
+}
+
+int cgroup_dir_of(int pid, char *dst, size_t size) {
+	char path[PATH_MAX], text[4096], *p;
+	const char *root = cgroup_root();
+
+	if (cgroup_arg && strcmp(cgroup_arg, "auto") != 0) {
+		/* a full path or one below the root */
+		if (strncmp(cgroup_arg, cgroupfs_root, strlen(cgroupfs_root)) == 0
+				&& cgroup_arg[strlen(cgroupfs_root)] == '/')
+			snprintf(dst, size, "%s", cgroup_arg);
+		else
+			snprintf(dst, size, "%s%s%s", root,
+					*cgroup_arg == '/' ? "" : "/", cgroup_arg);
+		return 0;
+	}
+	if (!pid)
+		return ESRCH;
+
+	/* the unified hierarchy entry: "0::/user.slice/..." */
+	snprintf(path, sizeof(path), "%s/%d/cgroup", procfs_root, pid);
+	if (read_file_to(path, 0, 1, text, sizeof(text)) != 0)
+		return ENOENT;
+	if ((p = strstr(text, "0::")) == NULL)
+		return ENOENT;
+	p += 3;
+	p[strcspn(p, "\n")] = '\0';
+	snprintf(dst, size, "%s%s", root, strcmp(p, "/") == 0 ? "" : p);
+	return 0;
+}
+
+static void parse_cpulist(const char *list, cpu_set_t *set) {
+	const char *p = list;
+	char *end;
+	long lo, hi, c;
+
+	CPU_ZERO(set);
+	while (*p && *p != '\n') {
+		lo = hi = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for (c = lo; c <= hi && c < CPU_SETSIZE; c++)
+			CPU_SET(c, set);
+		p = *end == ',' ? end + 1 : end;
+	}
+}
+
+/* the nearest cpuset.cpus.effective up the tree, all cpus without one */
+static void read_cpuset(void) {
+	char path[PATH_MAX], list[1024];
+	size_t len = strlen(dir), root_len = strlen(cgroup_root());
+	long c, n;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	while (len >= root_len) {
+		snprintf(path + len, sizeof(path) - len, "/cpuset.cpus.effective");
+		if (read_file_to(path, 0, 1, list, sizeof(list)) == 0 && *list != '\n') {
+			parse_cpulist(list, &cpuset);
+			ncpuset = CPU_COUNT(&cpuset);
+			return;
+		}
+		while (len > 0 && path[len - 1] != '/')
+			len--;
+		if (len > 0)
+			len--;
+	}
+	CPU_ZERO(&cpuset);
+	n = sysconf(_SC_NPROCESSORS_CONF);
+	for (c = 0; c < n && c < CPU_SETSIZE; c++)
+		CPU_SET(c, &cpuset);
+	ncpuset = CPU_COUNT(&cpuset);
+}
+
+static int read_usage(unsigned long long *usec) {
+	char text[1024], *p;
+
+	if (read_file_to(NULL, stat_fd, 0, text, sizeof(text)) != 0)
+		return -1;
+	if ((p = strstr(text, "usage_usec")) == NULL)
+		return -1;
+	*usec = strtoull(p + strlen("usage_usec"), NULL, 10);
+	return 0;
+}
+
+static int compare_tids(const void *a, const void *b) {
+	return ((const thread_time_t *)a)->tid - ((const thread_time_t *)b)->tid;
+}
+
+/*
+ * Account one thread: the cpu time it got since the last sample goes to
+ * the cpu it ran on last, the processor field of its stat.
+ */
+static void account_thread(int tid) {
+	char path[PATH_MAX], text[1024], *p;
+	unsigned long long utime, stime;
+	thread_time_t key, *prev, *t;
+	int cpu;
+
+	if (nthreads[cur_threads] >= MAX_CGROUP_THREADS)
+		return;
+	snprintf(path, sizeof(path), "%s/%d/stat", procfs_root, tid);
+	if (read_file_to(path, 0, 1, text, sizeof(text)) != 0
+			|| (p = strrchr(text, ')')) == NULL)
+		return;
+	/* after the comm: state is field 3, utime 14, stime 15, processor 39 */
+	if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+			"%*d %*d %*d %*d %*d %*d %*u %*u %*d %*u %*u %*u %*u %*u %*u "
+			"%*u %*u %*u %*u %*u %*u %*u %*d %d", &utime, &stime, &cpu) != 3)
+		return;
+
+	t = &threads[cur_threads][nthreads[cur_threads]++];
+	t->tid = tid;
+	t->ticks = utime + stime;
+	key.tid = tid;
+	prev = (thread_time_t *)bsearch(&key, threads[!cur_threads],
+			nthreads[!cur_threads], sizeof(thread_time_t), compare_tids);
+	if (prev && t->ticks > prev->ticks && cpu >= 0 && cpu < CPU_SETSIZE)
+		ran_ticks[cpu] += t->ticks - prev->ticks;
+}
+
+/* the threads of the cgroup and of the ones below it */
+static void account_threads(const char *path, int depth) {
+	char sub[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+	FILE *f;
+	int tid;
+
+	snprintf(sub, sizeof(sub), "%s/cgroup.threads", path);
+	if ((f = fopen(sub, "r")) != NULL) {
+		while (fscanf(f, "%d", &tid) == 1)
+			account_thread(tid);
+		fclose(f);
+	}
+	if (depth >= MAX_CGROUP_DEPTH || (d = opendir(path)) == NULL)
+		return;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_type != DT_DIR || de->d_name[0] == '.')
+			continue;
+		snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
+		account_threads(sub, depth + 1);
+	}
+	closedir(d);
+}
+
+/* the next thread snapshot, the previous one kept for the deltas */
+static void snapshot_threads(void) {
+	memset(ran_ticks, 0, sizeof(ran_ticks));
+	cur_threads = !cur_threads;
+	nthreads[cur_threads] = 0;
+	account_threads(dir, 0);
+	qsort(threads[cur_threads], nthreads[cur_threads], sizeof(thread_time_t),
+			compare_tids);
+}
+
+/*
+ * Where the threads ran since the last walk, as shares of the usage.
+ * Reading every thread's stat at each 5ms tick would cost more than
+ * what it measures: the shares are kept between walks.
+ */
+static void update_shares(long long now) {
+	double ran = 0;
+	int c;
+
+	if (now - walk_ns < THREAD_WALK_NS)
+		return;
+	walk_ns = now;
+	snapshot_threads();
+	for (c = 0; c < CPU_SETSIZE; c++)
+		ran += ran_ticks[c];
+	have_shares = ran > 0;
+	for (c = 0; c < CPU_SETSIZE; c++)
+		shares[c] = have_shares ? ran_ticks[c] / ran : 0;
+}
+
+int cgroup_load_open(int pid) {
+	char path[PATH_MAX];
+	int err;
+
+	cgroup_load_close();
+	if (!cgroup_arg)
+		return 0;
+	if ((err = cgroup_dir_of(pid, dir, sizeof(dir))) != 0)
+		return err;
+	/* jackd in no cgroup of its own: that would be every thread there is */
+	if (strcmp(cgroup_arg, "auto") == 0 && strcmp(dir, cgroup_root()) == 0) {
+		pprintf(1, "The JACK server runs in the root cgroup, "
+				"measuring the whole cpus\n");
+		return EINVAL;
+	}
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", dir);
+	if ((stat_fd = open(path, O_RDONLY)) < 0) {
+		err = errno;
+		pprintf(1, "Can't measure %s: %s\n", path, strerror(err));
+		return err;
+	}
+	if (read_usage(&last_usec) != 0) {
+		close(stat_fd);
+		stat_fd = -1;
+		return EINVAL;
+	}
+	last_ns = monotonic_ns();
+	read_cpuset();
+	snapshot_threads();
+	walk_ns = last_ns;
+	have_shares = 0;
+	pprintf(2, "Measuring the CPU load of %s on %d cpus\n", dir, ncpuset);
+	return 0;
+}
+
+void cgroup_load_close(void) {
+	if (stat_fd >= 0)
+		close(stat_fd);
+	stat_fd = -1;
+	have_load = 0;
+	nthreads[0] = nthreads[1] = 0;
+}
+
+int cgroup_load_active(void) {
+	return stat_fd >= 0;
+}
+
+/*
+ * usage_usec is exact but not per cpu: it goes to the cpus in proportion
+ * to where the threads of the cgroup ran. A saturated audio thread then
+ * shows as a saturated cpu, not as its share of the whole cpuset.
+ */
+void cgroup_load_sample(void) {
+	unsigned long long usec;
+	long long now = monotonic_ns();
+	double tick_usec;
+	int c;
+
+	if (stat_fd < 0)
+		return;
+	if (read_usage(&usec) != 0 || now <= last_ns || !ncpuset) {
+		have_load = 0;
+		return;
+	}
+
+	update_shares(now);
+	tick_usec = (now - last_ns) / 1000.0;
+	for (c = 0; c < CPU_SETSIZE; c++) {
+		/* below the tick resolution: no better guess than the cpuset */
+		if (have_shares)
+			loads[c] = (usec - last_usec) * shares[c] / tick_usec;
+		else
+			loads[c] = CPU_ISSET(c, &cpuset)
+				? (double)(usec - last_usec) / ncpuset / tick_usec : 0;
+		if (loads[c] > 1)
+			loads[c] = 1;
+		if (loads[c] > 0)
+			pprintf(4, "cgroup load: cpu%d %.1f%%\n", c, 100 * loads[c]);
+	}
+	have_load = 1;
+	last_usec = usec;
+	last_ns = now;
+}
+
+float cgroup_cpu_load(int cpu) {
+	if (!have_load)
+		return -1;
+	return cpu >= 0 && cpu < CPU_SETSIZE ? loads[cpu] : 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * CPU load of the audio workload measured through its cgroup v2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef CGROUP_LOAD_H
+#define CGROUP_LOAD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --cgroup: NULL - whole cpus, "auto" - the JACK server's, or a path */
+extern const char *cgroup_arg;
+
+/* where cgroupfs is mounted, a fake tree for testing */
+extern const char *cgroupfs_root;
+
+/* where the unified hierarchy is mounted */
+extern const char *cgroup_root(void);
+
+/**
+ * The cgroup directory of the audio workload: the configured one, or
+ * that of the process.
+ * @return 0 or errno
+ */
+extern int cgroup_dir_of(int pid, char *dst, size_t size);
+
+/**
+ * Start measuring the cgroup of the process, or the configured one.
+ * @return 0 or errno
+ */
+extern int cgroup_load_open(int pid);
+
+extern void cgroup_load_close(void);
+
+extern int cgroup_load_active(void);
+
+/* read usage_usec, once per tick */
+extern void cgroup_load_sample(void);
+
+/**
+ * The cgroup's utilization of a cpu over the last tick from 0 to 1, like
+ * the /proc/stat load: its usage split by where its threads ran. -1 if
+ * unknown.
+ */
+extern float cgroup_cpu_load(int cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CGROUP_LOAD_H */
@@ -0,0 +1,128 @@
+/*
+ * CPU frequency policies governed by jackfreqd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef CPUFREQ_H
+#define CPUFREQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum modes {
+	LOWER,
+	SAME,
+	RAISE
+};
+
+typedef struct cpustats {
+	unsigned long long user;
+	unsigned long long mynice;
+	unsigned long long system;
+	unsigned long long idle;
+	unsigned long long iowait;
+	unsigned long long irq;
+	unsigned long long softirq;
+} cpustats_t;
+
+/*
+ * A cpufreq policy: the set of cpus that always run at the same speed.
+ * Everything about the speed lives here and is shared by all its cpus.
+ */
+typedef struct policy {
+	unsigned int id;           /* the first cpu of the policy */
+	int ncpus;
+	int *cpus;
+	char *sysfs_dir;
+	unsigned int max_speed;
+	unsigned int min_speed;
+	unsigned int cpuinfo_max;  /* the hardware limits, whatever we prune */
+	unsigned int cpuinfo_min;
+	unsigned int current_speed;
+	unsigned int speed_index;
+	enum modes current_pstate_mode;
+	int wfd;
+	unsigned int write_latency_ns; /* of the last speed or mode write */
+	long long last_change_ns;      /* CLOCK_MONOTONIC, 0 - never */
+	int is_pstate;
+	int in_mhz; /* 0 = speed in kHz, 1 = speed in mHz */
+	unsigned long *freq_table;
+	int table_size;
+	/* closed-loop verification of the speed actually running */
+	int cur_fd;
+	unsigned char *freq_hits;   /* times each table entry was observed */
+	unsigned char *freq_misses; /* requests of an entry not taking effect */
+	int verify_pending;
+	int drift_reads;
+	/* learned DSP load model: load(f) = model_work * residual(f) / f */
+	double model_work;       /* DSP load in percent times kHz */
+	float *model_residual;   /* per table entry deviation from 1/f */
+	unsigned int model_samples;
+	int target_index;        /* where the model wants to go */
+	int sens_limited;        /* the frequency sensitivity sets target_index */
+	/* preemptive boost on session edits */
+	int boosted;
+	unsigned int boost_saved_index;
+	enum modes boost_saved_mode;
+	/* glitches following the speed transitions */
+	long long transition_ns;  /* the pending transition, 0 - none */
+	int transition_glitch;    /* a glitch followed it */
+	unsigned int transitions;
+	unsigned int glitchy_transitions;
+	int transition_unsafe;    /* transitions glitch too often */
+	unsigned int session_glitchy; /* glitchy transitions of this session */
+	int transition_locked;    /* the speed is held for the session */
+	int irq_floor_index;      /* slowest entry allowed, -1 - no floor */
+	/* scaling limits, in the units of the driver, with --actuator */
+	unsigned long saved_min;  /* found at startup */
+	unsigned long saved_max;
+	unsigned long limit_floor; /* the last floor written, 0 - none */
+	struct shadow_policy *shadow; /* the --shadow records */
+} policy_t;
+
+typedef struct cpuinfo {
+	unsigned int cpuid;
+	policy_t *policy;
+	cpustats_t *last_reading;
+	cpustats_t *reading;
+	int fd;
+	/* the scaling limits of its policy before we wrote any, 0 - unread */
+	unsigned long saved_min;
+	unsigned long saved_max;
+} cpuinfo_t;
+
+extern cpuinfo_t **all_cpus;
+extern policy_t **policies;
+extern int npolicies;
+
+/* the speed the driver reports, 0 if unknown */
+extern unsigned long read_cur_speed(policy_t *pol);
+
+/* the table entry closest to a speed */
+extern int nearest_speed_index(policy_t *pol, unsigned long speed);
+
+/* drop a frequency from the policy's table and its per-entry state */
+extern void remove_speed(policy_t *pol, int index);
+
+/* derive the speeds of a policy from its table and speed_index */
+extern void sync_policy_speed(policy_t *pol);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPUFREQ_H */
@@ -0,0 +1,215 @@
+/*
+ * CPU idle state (C-state) exit latency control
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "energy.h"
+#include "cpuidle.h"
+
+#define SYSFS_CPU_TREE "/sys/devices/system/cpu/"
+#define DMA_LATENCY_DEV "/dev/cpu_dma_latency"
+#define MAX_IDLE_STATES 16
+
+/*
+ * Periods up to this length are limited as soon as there is any DSP
+ * load, longer ones only when the load exceeds the upper limit.
+ */
+#define CSTATE_SMALL_PERIOD_USECS 2000
+
+typedef struct idle_state {
+	unsigned int latency; /* exit latency in usecs */
+	int disabled;         /* disabled by the system before we started */
+	int disabled_by_us;
+} idle_state_t;
+
+typedef struct idle_cpu {
+	int nstates;
+	idle_state_t states[MAX_IDLE_STATES];
+} idle_cpu_t;
+
+int cstate_mode = CSTATE_OFF;
+unsigned int cstate_budget_pct = 10;
+
+static idle_cpu_t *idle_cpus = NULL;
+static int idle_ncpus = 0;
+static int dma_fd = -1;
+static int engaged = 0;
+static unsigned int engaged_budget = 0;
+static unsigned int engage_count = 0;
+
+static energy_acct_t limited_acct;
+static energy_acct_t unlimited_acct;
+
+int cpuidle_init(int ncpus) {
+	char path[100], str[32];
+	int i, s;
+
+	if (cstate_mode != CSTATE_STATES)
+		return 0;
+
+	idle_cpus = (idle_cpu_t *)calloc(ncpus, sizeof(idle_cpu_t));
+	if (idle_cpus == NULL) {
+		perror("Couldn't allocate idle states");
+		return ENOMEM;
+	}
+	idle_ncpus = ncpus;
+
+	for (i = 0; i < ncpus; i++) {
+		for (s = 0; s < MAX_IDLE_STATES; s++) {
+			idle_state_t *st = &idle_cpus[i].states[s];
+
+			snprintf(path, sizeof(path),
+			    SYSFS_CPU_TREE "cpu%d/cpuidle/state%d/latency", i, s);
+			if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+				break;
+			st->latency = strtoul(str, NULL, 10);
+
+			snprintf(path, sizeof(path),
+			    SYSFS_CPU_TREE "cpu%d/cpuidle/state%d/disable", i, s);
+			if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+				break;
+			st->disabled = strtol(str, NULL, 10);
+		}
+		idle_cpus[i].nstates = s;
+		pprintf(4, "  cpu%d: %d idle states\n", i, s);
+	}
+	return 0;
+}
+
+static void set_state_disabled(int cpuid, int state, int disable) {
+	char path[100];
+	int err;
+
+	snprintf(path, sizeof(path),
+	    SYSFS_CPU_TREE "cpu%d/cpuidle/state%d/disable", cpuid, state);
+	if ((err = write_file(path, disable ? "1" : "0")) != 0)
+		pprintf(1, "Couldn't write %s: %s\n", path, strerror(err));
+	else
+		idle_cpus[cpuid].states[state].disabled_by_us = disable;
+}
+
+/*
+ * Disable the states with an exit latency above the budget on the cpus in
+ * the set, re-enable everything else we disabled before.
+ */
+static void limit_states(const cpu_set_t *cpus, unsigned int budget) {
+	int i, s;
+
+	for (i = 0; i < idle_ncpus; i++) {
+		int in_set = cpus == NULL || CPU_ISSET(i, cpus);
+
+		for (s = 0; s < idle_cpus[i].nstates; s++) {
+			idle_state_t *st = &idle_cpus[i].states[s];
+			int want = in_set && st->latency > budget && !st->disabled;
+
+			if (want != st->disabled_by_us)
+				set_state_disabled(i, s, want);
+		}
+	}
+}
+
+static void limit_dma_latency(unsigned int budget) {
+	int32_t val = budget;
+
+	if (shadow)
+		return;
+	if (dma_fd < 0 && (dma_fd = open(DMA_LATENCY_DEV, O_WRONLY)) < 0) {
+		perror("Can't open " DMA_LATENCY_DEV);
+		return;
+	}
+	/* the request stays in effect as long as the file is open */
+	if (write(dma_fd, &val, sizeof(val)) != sizeof(val))
+		perror("Can't write " DMA_LATENCY_DEV);
+}
+
+static void engage(int jack_pid, unsigned int budget) {
+	cpu_set_t cpus;
+	int have_set = 0;
+
+	if (engaged && budget == engaged_budget)
+		return;
+
+	pprintf(2, "Limiting idle state exit latency to %u usecs\n", budget);
+
+	if (cstate_mode == CSTATE_DMA) {
+		limit_dma_latency(budget);
+	} else {
+		CPU_ZERO(&cpus);
+		if (jack_pid && sched_getaffinity(jack_pid, sizeof(cpus), &cpus) == 0)
+			have_set = 1;
+		limit_states(have_set ? &cpus : NULL, budget);
+	}
+	if (!engaged)
+		engage_count++;
+	engaged = 1;
+	engaged_budget = budget;
+}
+
+void cpuidle_release(void) {
+	int i, s;
+
+	if (!engaged)
+		return;
+
+	pprintf(2, "Releasing idle state limits\n");
+
+	if (dma_fd >= 0) {
+		close(dma_fd);
+		dma_fd = -1;
+	}
+	for (i = 0; i < idle_ncpus; i++)
+		for (s = 0; s < idle_cpus[i].nstates; s++)
+			if (idle_cpus[i].states[s].disabled_by_us)
+				set_state_disabled(i, s, 0);
+	engaged = 0;
+}
+
+void cpuidle_update(int jack_pid, unsigned int period_usecs, float dspload) {
+	if (cstate_mode == CSTATE_OFF)
+		return;
+
+	/* the energy of the past tick belongs to the state it ran in */
+	energy_account(engaged ? &limited_acct : &unlimited_acct);
+
+	if (!period_usecs || dspload < lowwater_dsp) {
+		cpuidle_release();
+	} else if (dspload > highwater_dsp
+	    || period_usecs <= CSTATE_SMALL_PERIOD_USECS) {
+		engage(jack_pid, period_usecs * cstate_budget_pct / 100);
+	}
+}
+
+void cpuidle_report(int level) {
+	if (cstate_mode == CSTATE_OFF)
+		return;
+
+	pprintf(level, "  idle states limited %u times\n", engage_count);
+	energy_report(level, "with idle states limited", &limited_acct);
+	energy_report(level, "with idle states unlimited", &unlimited_acct);
+}
@@ -0,0 +1,59 @@
+/*
+ * CPU idle state (C-state) exit latency control
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef CPUIDLE_H
+#define CPUIDLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum cstate_modes {
+	CSTATE_OFF,     /* leave idle states alone */
+	CSTATE_DMA,     /* hold a /dev/cpu_dma_latency request */
+	CSTATE_STATES   /* disable cpuidle/stateN on the JACK cpus */
+};
+
+extern int cstate_mode;
+extern unsigned int cstate_budget_pct;
+
+/**
+ * Read the idle states of all cpus.
+ * @return 0 or errno
+ */
+extern int cpuidle_init(int ncpus);
+
+/**
+ * Update the idle state limits for the current session.
+ * @param jack_pid the JACK server process, its cpu affinity selects the
+ *   cpus to limit (0 - all cpus)
+ * @param period_usecs the JACK period, 0 if not connected
+ * @param dspload the DSP load in percent
+ */
+extern void cpuidle_update(int jack_pid, unsigned int period_usecs, float dspload);
+
+/* restore all the idle states we changed */
+extern void cpuidle_release(void);
+
+extern void cpuidle_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPUIDLE_H */
@@ -0,0 +1,135 @@
+/*
+ * Package energy accounting through the powercap (RAPL) interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "energy.h"
+
+#define POWERCAP_TREE "/sys/class/powercap/"
+#define MAX_ENERGY_ZONES 16
+
+typedef struct energy_zone {
+	int fd;
+	unsigned long long last_uj;
+	unsigned long long range_uj;
+} energy_zone_t;
+
+static energy_zone_t zones[MAX_ENERGY_ZONES];
+static int nzones = 0;
+static struct timespec last_ts;
+
+double tick_joules = -1.0;
+double tick_seconds = 0.0;
+
+static int read_counter(int fd, unsigned long long *val) {
+	char str[32];
+
+	if (read_file_to(NULL, fd, 0, str, sizeof(str)) != 0)
+		return -1;
+	*val = strtoull(str, NULL, 10);
+	return 0;
+}
+
+int energy_init(void) {
+	char path[100], str[32];
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &last_ts);
+
+	/* package zones only: intel-rapl:N, the subzones are included */
+	for (i = 0; i < MAX_ENERGY_ZONES; i++) {
+		energy_zone_t *z = &zones[nzones];
+
+		snprintf(path, sizeof(path),
+		    POWERCAP_TREE "intel-rapl:%d/max_energy_range_uj", i);
+		if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+			break;
+		z->range_uj = strtoull(str, NULL, 10);
+
+		snprintf(path, sizeof(path), POWERCAP_TREE "intel-rapl:%d/energy_uj", i);
+		if ((z->fd = open(path, O_RDONLY)) < 0)
+			break;
+		if (read_counter(z->fd, &z->last_uj) != 0) {
+			close(z->fd);
+			break;
+		}
+		nzones++;
+	}
+
+	if (nzones)
+		pprintf(2, "Measuring energy of %d package%s\n", nzones,
+		    nzones > 1 ? "s" : "");
+	else
+		pprintf(2, "Package energy is not measurable\n");
+	return nzones;
+}
+
+void energy_sample(void) {
+	struct timespec now;
+	unsigned long long uj, delta_uj = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tick_seconds = (now.tv_sec - last_ts.tv_sec)
+	    + (now.tv_nsec - last_ts.tv_nsec) / 1e9;
+	last_ts = now;
+
+	if (!nzones) {
+		tick_joules = -1.0;
+		return;
+	}
+
+	for (i = 0; i < nzones; i++) {
+		if (read_counter(zones[i].fd, &uj) != 0) {
+			tick_joules = -1.0;
+			return;
+		}
+		/* the counter wraps at max_energy_range_uj */
+		if (uj >= zones[i].last_uj)
+			delta_uj += uj - zones[i].last_uj;
+		else
+			delta_uj += zones[i].range_uj - zones[i].last_uj + uj;
+		zones[i].last_uj = uj;
+	}
+	tick_joules = delta_uj / 1e6;
+}
+
+void energy_close(void) {
+	int i;
+
+	for (i = 0; i < nzones; i++)
+		close(zones[i].fd);
+	nzones = 0;
+}
+
+void energy_report(int level, const char *what, const energy_acct_t *a) {
+	if (nzones && a->seconds > 0)
+		pprintf(level, "  %s: %.0f seconds, %.0f J, %.2f W average\n",
+		    what, a->seconds, a->joules, a->joules / a->seconds);
+	else
+		pprintf(level, "  %s: %.0f seconds\n", what, a->seconds);
+}
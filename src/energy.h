@@ -0,0 +1,65 @@
+/*
+ * Package energy accounting through the powercap (RAPL) interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* energy spent and time elapsed while some condition held */
+typedef struct energy_acct {
+	double joules;
+	double seconds;
+} energy_acct_t;
+
+/* what the last energy_sample() measured, attributed by the features */
+extern double tick_joules;
+extern double tick_seconds;
+
+/**
+ * Find the package energy counters.
+ * @return the number of counters found, 0 if energy is not measurable
+ */
+extern int energy_init(void);
+
+/**
+ * Update tick_joules and tick_seconds with the energy and time since
+ * the previous call. tick_joules is negative if energy is not measurable.
+ */
+extern void energy_sample(void);
+
+extern void energy_close(void);
+
+static inline void energy_account(energy_acct_t *a) {
+	if (tick_joules > 0)
+		a->joules += tick_joules;
+	a->seconds += tick_seconds;
+}
+
+/**
+ * Print time and average power of an account at the given verbosity.
+ */
+extern void energy_report(int level, const char *what, const energy_acct_t *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENERGY_H */
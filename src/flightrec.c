@@ -0,0 +1,217 @@
+/*
+ * In-memory flight recorder of the governor ticks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "flightrec.h"
+
+#define FLIGHTREC_MAGIC 0x4a465252 /* "JFRR" */
+#define FLIGHTREC_VERSION 1
+
+/* smaller policy values are intel_pstate modes, not speeds */
+#define FLIGHTREC_MIN_KHZ 1000
+
+/* the dump file is this structure, byte for byte */
+typedef struct flightrec {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t entries;
+	uint64_t head;        /* entries recorded so far */
+	int64_t dump_ns;      /* CLOCK_MONOTONIC at the dump */
+	int64_t dump_time;    /* the wall clock at the dump */
+	flightrec_entry_t ring[FLIGHTREC_ENTRIES];
+} flightrec_t;
+
+int flightrec_enabled = 1;
+
+/* written by the main loop only */
+static flightrec_t rec = {
+	.magic = FLIGHTREC_MAGIC,
+	.version = FLIGHTREC_VERSION,
+	.entry_size = sizeof(flightrec_entry_t),
+	.entries = FLIGHTREC_ENTRIES
+};
+
+static const char *const decision_names[] = {"lower", "same", "raise"};
+
+static inline flightrec_entry_t *next_entry(void) {
+	return &rec.ring[rec.head++ & (FLIGHTREC_ENTRIES - 1)];
+}
+
+void flightrec_tick(int reasons, float load, unsigned int interval_ms) {
+	flightrec_entry_t *e;
+
+	if (!flightrec_enabled)
+		return;
+	e = next_entry();
+	e->ns = monotonic_ns();
+	e->kind = FR_TICK;
+	e->decision = 0;
+	e->policy = 0;
+	e->value = reasons;
+	e->latency_ns = interval_ms;
+	e->load = load;
+}
+
+void flightrec_policy(unsigned int policy, int decision,
+		uint32_t value, uint32_t latency_ns, float load) {
+	flightrec_entry_t *e;
+
+	if (!flightrec_enabled)
+		return;
+	e = next_entry();
+	e->ns = monotonic_ns();
+	e->kind = FR_POLICY;
+	e->decision = decision;
+	e->policy = policy;
+	e->value = value;
+	e->latency_ns = latency_ns;
+	e->load = load;
+}
+
+int flightrec_dump(const char *why) {
+	char path[100];
+	int fd, err = 0;
+	ssize_t len;
+
+	if (!flightrec_enabled)
+		return 0;
+
+	rec.dump_ns = monotonic_ns();
+	rec.dump_time = time(NULL);
+
+	if (mkdir(FLIGHTREC_DIR, 0755) != 0 && errno != EEXIST)
+		return errno;
+	snprintf(path, sizeof(path), FLIGHTREC_DIR "/flight-%lld.rec",
+	    (long long)rec.dump_time);
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		err = errno;
+		pprintf(1, "Can't create %s: %s\n", path, strerror(err));
+		return err;
+	}
+	if ((len = write(fd, &rec, sizeof(rec))) != sizeof(rec)) {
+		err = len < 0 ? errno : EPIPE;
+		pprintf(1, "Can't write %s: %s\n", path, strerror(err));
+	}
+	close(fd);
+	if (!err)
+		pprintf(1, "Flight recorder dumped to %s on %s\n", path, why);
+	return err;
+}
+
+/* read and check a dump, returns a malloc'ed copy or NULL */
+static flightrec_t *load_dump(const char *file) {
+	flightrec_t *r;
+	int fd;
+
+	if ((r = (flightrec_t *)malloc(sizeof(*r))) == NULL)
+		return NULL;
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		perror(file);
+		free(r);
+		return NULL;
+	}
+	if (read(fd, r, sizeof(*r)) != sizeof(*r) || r->magic != FLIGHTREC_MAGIC
+	    || r->version != FLIGHTREC_VERSION
+	    || r->entry_size != sizeof(flightrec_entry_t)
+	    || r->entries != FLIGHTREC_ENTRIES) {
+		fprintf(stderr, "%s: not a jackfreqd flight recording\n", file);
+		free(r);
+		r = NULL;
+	}
+	close(fd);
+	return r;
+}
+
+static uint64_t first_entry(const flightrec_t *r) {
+	return r->head > FLIGHTREC_ENTRIES ? r->head - FLIGHTREC_ENTRIES : 0;
+}
+
+int flightrec_decode(const char *file) {
+	flightrec_t *r;
+	uint64_t i;
+	time_t dumped;
+
+	if ((r = load_dump(file)) == NULL)
+		return EINVAL;
+
+	dumped = r->dump_time;
+	printf("# dumped at %s", ctime(&dumped));
+	printf("# seconds before the dump, event, details\n");
+	for (i = first_entry(r); i < r->head; i++) {
+		flightrec_entry_t *e = &r->ring[i & (FLIGHTREC_ENTRIES - 1)];
+		double t = (e->ns - r->dump_ns) / 1e9;
+
+		if (e->kind == FR_TICK)
+			printf("%10.3f tick   load %5.1f%% wake %#x after %u ms\n",
+			    t, e->load, e->value, e->latency_ns);
+		else
+			printf("%10.3f policy %u %-5s %u, write took %u us\n",
+			    t, e->policy, e->decision <= 2
+			    ? decision_names[e->decision] : "?",
+			    e->value, e->latency_ns / 1000);
+	}
+	free(r);
+	return 0;
+}
+
+int flightrec_read(const char *file, flightrec_entry_t **ticks, size_t *n) {
+	flightrec_t *r;
+	flightrec_entry_t *t;
+	uint64_t i;
+	size_t k = 0;
+	uint32_t speed = 0;
+	int seen_policy = 0;
+
+	if ((r = load_dump(file)) == NULL)
+		return EINVAL;
+	if ((t = (flightrec_entry_t *)calloc(FLIGHTREC_ENTRIES, sizeof(*t))) == NULL) {
+		free(r);
+		return ENOMEM;
+	}
+
+	/* a tick's load was measured at the speed the previous tick left */
+	for (i = first_entry(r); i < r->head; i++) {
+		flightrec_entry_t *e = &r->ring[i & (FLIGHTREC_ENTRIES - 1)];
+
+		if (e->kind == FR_TICK) {
+			t[k] = *e;
+			t[k++].value = speed;
+			seen_policy = 0;
+		} else if (!seen_policy) {
+			seen_policy = 1;
+			speed = e->value > FLIGHTREC_MIN_KHZ ? e->value : 0;
+		}
+	}
+	free(r);
+	*ticks = t;
+	*n = k;
+	return 0;
+}
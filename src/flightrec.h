@@ -0,0 +1,81 @@
+/*
+ * In-memory flight recorder of the governor ticks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLIGHTREC_DIR "/run/jackfreqd"
+#define FLIGHTREC_ENTRIES 8192 /* a power of 2 */
+
+enum flightrec_kinds {
+	FR_TICK,     /* value: wake reasons, latency_ns: the poll interval in ms */
+	FR_POLICY    /* value: the speed or pstate mode after the decision */
+};
+
+/* one recorded event, fixed size so the ring can be dumped as is */
+typedef struct flightrec_entry {
+	int64_t ns;           /* CLOCK_MONOTONIC */
+	uint8_t kind;
+	uint8_t decision;     /* enum modes */
+	uint16_t policy;
+	uint32_t value;
+	uint32_t latency_ns;  /* of the sysfs write, FR_POLICY only */
+	float load;
+} flightrec_entry_t;
+
+extern int flightrec_enabled;
+
+/* record a tick, cheap enough for every tick */
+extern void flightrec_tick(int reasons, float load, unsigned int interval_ms);
+
+extern void flightrec_policy(unsigned int policy, int decision,
+		uint32_t value, uint32_t latency_ns, float load);
+
+/**
+ * Write the ring to FLIGHTREC_DIR/flight-<time>.rec with one write().
+ * @param why what triggered the dump, for the log
+ * @return 0 or errno
+ */
+extern int flightrec_dump(const char *why);
+
+/**
+ * Print a dump in text form.
+ * @return 0 or errno
+ */
+extern int flightrec_decode(const char *file);
+
+/**
+ * Read the ticks of a dump, oldest first, for replaying them.
+ * @param ticks receives a malloc'ed array of the FR_TICK entries, their
+ *   value replaced by the speed of the first policy during the tick in
+ *   kHz, 0 if unknown
+ * @return 0 or errno
+ */
+extern int flightrec_read(const char *file, flightrec_entry_t **ticks, size_t *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLIGHTREC_H */
@@ -0,0 +1,166 @@
+/*
+ * Correlation of frequency transitions with xruns and late cycles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "glitch.h"
+
+#define GLITCH_RING_SIZE 256 /* a power of 2 */
+#define GLITCH_MIN_TRANSITIONS 8
+/* glitchy transitions a session needs of its own before it locks */
+#define GLITCH_CONFIRM_TRANSITIONS 2
+
+unsigned int glitch_window_ms = 100;
+unsigned int glitch_threshold_pct = 0;
+
+/* written by the JACK threads, read by the main loop */
+static long long ring[GLITCH_RING_SIZE];
+static unsigned int ring_head = 0;
+static unsigned int ring_tail = 0;
+
+/* glitches outside every transition window give the background rate */
+static unsigned int background_glitches = 0;
+static double observed_seconds = 0;
+static long long last_update_ns = 0;
+
+void glitch_record(long long ns) {
+	unsigned int slot = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+
+	/* a slot read while still being written counts as background */
+	__atomic_store_n(&ring[slot % GLITCH_RING_SIZE], ns, __ATOMIC_RELEASE);
+}
+
+/* close the window of the pending transition */
+static void resolve(policy_t *pol) {
+	if (!pol->transition_ns)
+		return;
+	pol->transitions++;
+	if (pol->transition_glitch) {
+		pol->glitchy_transitions++;
+		pol->session_glitchy++;
+	}
+	pol->transition_ns = 0;
+	pol->transition_glitch = 0;
+}
+
+void glitch_transition(policy_t *pol, long long ns) {
+	resolve(pol);
+	pol->transition_ns = ns;
+}
+
+static double background_p(void) {
+	double p;
+
+	if (observed_seconds <= 0)
+		return 0;
+	p = background_glitches * (glitch_window_ms / 1000.0) / observed_seconds;
+	return p < 1.0 ? p : 1.0;
+}
+
+/* how much more likely a glitch is right after a transition */
+static double transition_p(const policy_t *pol) {
+	double p;
+
+	if (!pol->transitions)
+		return 0;
+	p = (double)pol->glitchy_transitions / pol->transitions - background_p();
+	return p > 0 ? p : 0;
+}
+
+void glitch_update(long long now) {
+	long long window = glitch_window_ms * 1000000LL;
+	unsigned int head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+	int i;
+
+	if (last_update_ns)
+		observed_seconds += (now - last_update_ns) / 1e9;
+	last_update_ns = now;
+
+	/* the ring overran: the oldest glitches are lost */
+	if (head - ring_tail > GLITCH_RING_SIZE)
+		ring_tail = head - GLITCH_RING_SIZE;
+
+	for (; ring_tail != head; ring_tail++) {
+		long long ts = __atomic_load_n(&ring[ring_tail % GLITCH_RING_SIZE],
+		    __ATOMIC_ACQUIRE);
+		int attributed = 0;
+
+		for (i = 0; i < npolicies; i++) {
+			policy_t *pol = policies[i];
+
+			if (pol->transition_ns && ts >= pol->transition_ns
+			    && ts - pol->transition_ns <= window) {
+				pol->transition_glitch = 1;
+				attributed = 1;
+			}
+		}
+		if (!attributed)
+			background_glitches++;
+	}
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->transition_ns && now - pol->transition_ns > window)
+			resolve(pol);
+		if (!glitch_threshold_pct || pol->transition_unsafe
+		    || pol->transitions < GLITCH_MIN_TRANSITIONS
+		    || pol->session_glitchy < GLITCH_CONFIRM_TRANSITIONS)
+			continue;
+		if (transition_p(pol) * 100 > glitch_threshold_pct) {
+			pol->transition_unsafe = 1;
+			pprintf(0, "policy %d: %.0f%% of the transitions glitch, "
+			    "locking its speed while JACK runs\n",
+			    pol->id, transition_p(pol) * 100);
+		}
+	}
+}
+
+void glitch_new_session(void) {
+	int i;
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		pol->transition_unsafe = 0;
+		pol->session_glitchy = 0;
+		pol->transitions /= 2;
+		pol->glitchy_transitions /= 2;
+	}
+}
+
+void glitch_report(int level) {
+	int i;
+
+	pprintf(level, "Transition glitches:\n");
+	pprintf(level, "  %u glitches outside transitions in %.0f seconds\n",
+	    background_glitches, observed_seconds);
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (!pol->transitions)
+			continue;
+		pprintf(level, "  policy %d: %u of %u transitions glitched, "
+		    "transition glitch probability %.1f%%%s\n", pol->id,
+		    pol->glitchy_transitions, pol->transitions,
+		    transition_p(pol) * 100,
+		    pol->transition_unsafe ? ", transition-unsafe" : "");
+	}
+}
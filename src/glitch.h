@@ -0,0 +1,60 @@
+/*
+ * Correlation of frequency transitions with xruns and late cycles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef GLITCH_H
+#define GLITCH_H
+
+#include "cpufreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern unsigned int glitch_window_ms;
+extern unsigned int glitch_threshold_pct; /* 0 - measure only */
+
+/**
+ * Record a glitch (xrun or late cycle) at the monotonic time ns.
+ * Safe to call from the JACK threads: lock-free, no syscalls.
+ */
+extern void glitch_record(long long ns);
+
+/* a speed or mode was written to the policy at the monotonic time ns */
+extern void glitch_transition(policy_t *pol, long long ns);
+
+/**
+ * Attribute the glitches recorded since the last call to the transitions
+ * before them and mark policies whose transitions cause glitches more
+ * often than the threshold as transition-unsafe. Call once per tick
+ * while a JACK server is connected.
+ */
+extern void glitch_update(long long now);
+
+/**
+ * A session starts: the history weighs half, and a policy is only
+ * transition-unsafe again once its transitions glitch in this session.
+ */
+extern void glitch_new_session(void);
+
+extern void glitch_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GLITCH_H */
@@ -2,7 +2,9 @@
 #define GLOBALS_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <syslog.h>
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,17 +13,66 @@ extern "C" {
 /* extern globals */
 extern int run;
 extern int jack_reconnect;
-extern int shutdown;
+extern int server_shutdown;
 extern pthread_cond_t jack_trigger_cond;
 extern int daemonize;
 extern int verbosity;
+extern unsigned int highwater_dsp;
+extern unsigned int lowwater_dsp;
+
+/* which statistic of the per-cycle DSP load feeds the governor */
+enum dsp_stats {
+	DSP_STAT_MEAN,
+	DSP_STAT_P50,
+	DSP_STAT_P95,
+	DSP_STAT_P99,
+	DSP_STAT_MAX
+};
+extern int dsp_stat;
+
+/* why the main loop woke up, a bit mask */
+enum wake_reasons {
+	WAKE_TIMEOUT = 0,
+	WAKE_GRAPH = 1,
+	WAKE_XRUN = 2,
+	WAKE_CLIENT = 4,   /* a client registered */
+	WAKE_BUFSIZE = 8,  /* the buffer size changed */
+	WAKE_SIGNAL = 16,
+	WAKE_PORT = 32,       /* ports were connected */
+	WAKE_TRANSPORT = 64,  /* the transport started */
+	WAKE_PRESSURE = 128,  /* a CPU pressure stall trigger fired */
+	WAKE_HOTPLUG = 256    /* a cpu went online or offline */
+};
+
+/* events announcing more DSP work in the next cycles */
+#define WAKE_SESSION_EDIT (WAKE_GRAPH | WAKE_CLIENT | WAKE_BUFSIZE)
+
+/**
+ * Wake the main loop up before its poll interval expires. Does not allocate
+ * nor wait for the main loop, but signalling the condition variable takes
+ * its internal lock and may futex-wake the waiter: keep it off the
+ * per-cycle path of the JACK process callback.
+ */
+extern void trigger_wakeup(int reason);
+extern long long monotonic_ns(void);
+
+/* where procfs is mounted, a fake tree for testing the procfs readers */
+extern const char *procfs_root;
+
+/* --shadow: decide everything, write nothing that changes the system */
+extern int shadow;
+
+/**
+ * Queue a message for the logger thread, or write it right away to
+ * syslog or stdout while the thread is not running. Never blocks on the
+ * log destination once the thread runs; see logger.h.
+ */
+extern void log_printf(int level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
 #define pprintf(level, ...) do { \
-	if ((level) <= verbosity) { \
-		if (daemonize) \
-			syslog(LOG_INFO, __VA_ARGS__); \
-		else \
-			printf(__VA_ARGS__); \
-	} \
+	if ((level) <= verbosity) \
+		log_printf(level, __VA_ARGS__); \
 } while(0)
 
 typedef struct {
@@ -43,6 +94,8 @@ extern int get_jack_proc(
 extern int get_xdg_runtime_dir (int pid, char *runtime_dir);
 
 /* prototypes */
+extern int read_file_to(const char *file, int fd, int new, char *dst, size_t size);
+extern int write_file(const char *file, const char *str);
 extern void drop_privileges(const ProcessInfo *jack_server_process);
 extern void restore_privileges();
 extern void get_jack_uid(
@@ -53,6 +106,12 @@ extern int jjack_is_open();
 extern int jjack_open(const ProcessInfo *jack_server_process);
 extern void jjack_close();
 extern float jjack_poll();
+extern unsigned int jjack_period_usecs();
+extern unsigned int jjack_xruns();
+extern int jjack_rt_priority();
+extern int jjack_transport_rolling();
+extern void jjack_watch_transport(int on);
+extern int jjack_connections();
 
 
 #ifdef __cplusplus
@@ -0,0 +1,46 @@
+/*
+ * The threshold governor, shared by jackfreqd and jackfreqd-tune
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include "governor.h"
+
+enum modes governor_decide(const governor_params_t *p,
+		int dsp_raise, int dsp_lower, float cpu_pct, int at_max, int at_min) {
+	if (p->use_cpu_load) {
+		if (governor_cpu_bound(p, cpu_pct) && !at_max)
+			return RAISE;
+		if (dsp_raise && !at_max)
+			return RAISE;
+		if (dsp_lower && cpu_pct <= p->lowwater_cpu / 100.0 && !at_min)
+			return LOWER;
+		return SAME;
+	}
+
+	if (dsp_raise && !at_max)
+		return RAISE;
+	if (dsp_lower && !at_min)
+		return LOWER;
+	return SAME;
+}
+
+int governor_next_index(enum modes mode, int index, int table_size) {
+	if (mode == RAISE)
+		return 0;
+	if (mode == LOWER && index < table_size - 1)
+		return index + 1;
+	return index;
+}
@@ -0,0 +1,67 @@
+/*
+ * The threshold governor, shared by jackfreqd and jackfreqd-tune
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "cpufreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct governor_params {
+	unsigned int highwater_dsp;  /* DSP load percent */
+	unsigned int lowwater_dsp;
+	int use_cpu_load;
+	unsigned int highwater_cpu;  /* CPU load percent */
+	unsigned int lowwater_cpu;
+} governor_params_t;
+
+/* whether the DSP load alone calls for a faster or a slower speed */
+static inline void governor_dsp_limits(const governor_params_t *p,
+		float dspload, int *raise, int *lower) {
+	*raise = dspload > p->highwater_dsp;
+	*lower = dspload < p->lowwater_dsp;
+}
+
+/**
+ * Decide on the speed of a cpu.
+ * @param dsp_raise, dsp_lower what the DSP load calls for
+ * @param cpu_pct the CPU load [0 .. 1], only used with use_cpu_load
+ * @param at_max, at_min whether the cpu already runs at the limit
+ */
+extern enum modes governor_decide(const governor_params_t *p,
+		int dsp_raise, int dsp_lower, float cpu_pct, int at_max, int at_min);
+
+/* the CPU load alone forces the highest speed */
+static inline int governor_cpu_bound(const governor_params_t *p, float cpu_pct) {
+	return p->use_cpu_load && cpu_pct >= p->highwater_cpu / 100.0;
+}
+
+/**
+ * The frequency table index a decision leads to: all the way up on
+ * RAISE, one step down on LOWER. Index 0 is the highest speed.
+ */
+extern int governor_next_index(enum modes mode, int index, int table_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GOVERNOR_H */
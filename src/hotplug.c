@@ -0,0 +1,175 @@
+/*
+ * CPU online and offline events from the kernel uevent netlink socket
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "globals.h"
+#include "hotplug.h"
+
+#define SYSFS_ONLINE "/sys/devices/system/cpu/online"
+#define UEVENT_SIZE 8192
+#define CPU_DEVPATH "/devices/system/cpu/cpu"
+#define HOTPLUG_POLL_NS 5000000000LL
+
+static int sock = -1;
+static pthread_t hotplug_thread;
+static int running = 0;
+static int watched = 0;
+static pthread_mutex_t changed_lock = PTHREAD_MUTEX_INITIALIZER;
+static cpu_set_t changed;
+/* the fallback without uevents */
+static char last_online[256];
+static long long last_poll_ns = 0;
+
+static void mark_changed(int cpu) {
+	if (cpu < 0 || cpu >= watched)
+		return;
+	pthread_mutex_lock(&changed_lock);
+	CPU_SET(cpu, &changed);
+	pthread_mutex_unlock(&changed_lock);
+}
+
+/*
+ * A uevent is "action@devpath" and then KEY=value strings, all NUL
+ * terminated: online@/devices/system/cpu/cpu3, ACTION=online, ...
+ */
+static int parse_uevent(const char *msg, int len) {
+	const char *p = msg, *end = msg + len, *action = NULL, *devpath = NULL;
+
+	for (; p < end; p += strlen(p) + 1) {
+		if (strncmp(p, "ACTION=", 7) == 0)
+			action = p + 7;
+		else if (strncmp(p, "DEVPATH=", 8) == 0)
+			devpath = p + 8;
+	}
+	if (!action || !devpath || (strcmp(action, "online") != 0
+			&& strcmp(action, "offline") != 0))
+		return -1;
+	if (strncmp(devpath, CPU_DEVPATH, strlen(CPU_DEVPATH)) != 0)
+		return -1;
+	return atoi(devpath + strlen(CPU_DEVPATH));
+}
+
+static void *listen_uevents(void *arg) {
+	char msg[UEVENT_SIZE];
+	sigset_t all;
+	int len, cpu;
+
+	/* signals are for the main loop */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	while ((len = recv(sock, msg, sizeof(msg) - 1, 0)) != 0) {
+		if (len < 0) {
+			if (errno == EINTR || errno == ENOBUFS)
+				continue;
+			break;
+		}
+		msg[len] = '\0';
+		if ((cpu = parse_uevent(msg, len)) < 0)
+			continue;
+		pprintf(3, "cpu%d: %s\n", cpu, msg);
+		mark_changed(cpu);
+		trigger_wakeup(WAKE_HOTPLUG);
+	}
+	return NULL;
+}
+
+int hotplug_start(int ncpus) {
+	struct sockaddr_nl addr;
+	int err;
+
+	watched = ncpus;
+	CPU_ZERO(&changed);
+	read_file_to(SYSFS_ONLINE, 0, 1, last_online, sizeof(last_online));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; /* the kernel's uevent broadcast */
+	if ((sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+			NETLINK_KOBJECT_UEVENT)) < 0
+			|| bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		err = errno;
+		pprintf(1, "Can't listen for cpu hotplug events: %s, polling %s\n",
+				strerror(err), SYSFS_ONLINE);
+		if (sock >= 0)
+			close(sock);
+		sock = -1;
+		return err;
+	}
+	if ((err = pthread_create(&hotplug_thread, NULL, listen_uevents, NULL)) != 0) {
+		close(sock);
+		sock = -1;
+		return err;
+	}
+	running = 1;
+	return 0;
+}
+
+void hotplug_stop(void) {
+	if (!running)
+		return;
+	/* wakes the recv() up with 0 */
+	shutdown(sock, SHUT_RDWR);
+	pthread_cancel(hotplug_thread);
+	pthread_join(hotplug_thread, NULL);
+	close(sock);
+	sock = -1;
+	running = 0;
+}
+
+int hotplug_next(void) {
+	int cpu;
+
+	pthread_mutex_lock(&changed_lock);
+	for (cpu = 0; cpu < watched; cpu++)
+		if (CPU_ISSET(cpu, &changed))
+			break;
+	if (cpu < watched)
+		CPU_CLR(cpu, &changed);
+	pthread_mutex_unlock(&changed_lock);
+	return cpu < watched ? cpu : -1;
+}
+
+void hotplug_poll(long long now) {
+	char online[256];
+	int cpu;
+
+	if (running || now - last_poll_ns < HOTPLUG_POLL_NS)
+		return;
+	last_poll_ns = now;
+	if (read_file_to(SYSFS_ONLINE, 0, 1, online, sizeof(online)) != 0
+			|| strcmp(online, last_online) == 0)
+		return;
+	/* the main loop sorts out which ones really changed */
+	strcpy(last_online, online);
+	for (cpu = 0; cpu < watched; cpu++)
+		mark_changed(cpu);
+	trigger_wakeup(WAKE_HOTPLUG);
+}
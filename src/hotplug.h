@@ -0,0 +1,49 @@
+/*
+ * CPU online and offline events from the kernel uevent netlink socket
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Listen for cpu online and offline uevents, waking the main loop with
+ * WAKE_HOTPLUG. Without the netlink socket the list of online cpus is
+ * compared every few seconds instead.
+ * @param ncpus the cpus to watch
+ * @return 0 or errno
+ */
+extern int hotplug_start(int ncpus);
+
+extern void hotplug_stop(void);
+
+/**
+ * The next cpu whose online state may have changed, -1 - none.
+ */
+extern int hotplug_next(void);
+
+/* check the polled online list, for when there is no netlink socket */
+extern void hotplug_poll(long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOTPLUG_H */
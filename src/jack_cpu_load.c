@@ -30,13 +30,50 @@
 #include <jack/jack.h>
 
 #include "globals.h"
+#include "load_hist.h"
+#include "glitch.h"
 
 jack_client_t *client = NULL;
 
+/*
+ * Per-cycle DSP load samples. The process thread fills
+ * window_hist[window_active]; jjack_poll() flips the index once per
+ * governor tick and evaluates the window that was just closed, once
+ * window_adding shows no add into it is still in flight: the process
+ * thread raises it before it reads the index.
+ * server_hist accumulates all the windows of the current server.
+ */
+static load_hist_t window_hist[2];
+static int window_active = 0;
+static int window_adding = 0;
+static load_hist_t server_hist;
+static unsigned int xrun_count = 0;
+/* set once our own activation has settled, later events are session edits */
+static int settled = 0;
+static jack_nframes_t buffer_size = 0;
+/* the port graph changed since the connections were last counted */
+static int ports_changed = 1;
+static int connections = 0;
+/* wake the main loop once when the transport starts */
+static int watch_transport = 0;
+
+/* when the next cycle should start, in JACK usecs */
+static jack_time_t expected_cycle = 0;
+
+/* a cycle starting this late (in periods) counts as a glitch */
+#define LATE_CYCLE_FRACTION 0.25
+
+static const float dsp_stat_quantile[] = {
+	[DSP_STAT_P50] = 0.50,
+	[DSP_STAT_P95] = 0.95,
+	[DSP_STAT_P99] = 0.99,
+	[DSP_STAT_MAX] = 1.00,
+};
+
 void jack_shutdown (void *arg) {
 	pprintf (1, "jack-shutdown received.\n");
 	if (jack_reconnect) {
-		shutdown=1;
+		server_shutdown=1;
 	} else {
 		run=0;
 	}
@@ -44,12 +81,72 @@ void jack_shutdown (void *arg) {
 
 void jack_trigger_port (jack_port_id_t a, jack_port_id_t b, int connect, void *arg) {
 	pprintf (4, "jack-port-connect trigger..\n");
-	pthread_cond_signal(&jack_trigger_cond);
+	__atomic_store_n(&ports_changed, 1, __ATOMIC_RELEASE);
+	/* only an idle session waits for a new connection, the rest is polled */
+	if (connect && __atomic_load_n(&watch_transport, __ATOMIC_RELAXED))
+		trigger_wakeup(WAKE_PORT);
+}
+
+void jack_trigger_port_registration (jack_port_id_t port, int reg, void *arg) {
+	__atomic_store_n(&ports_changed, 1, __ATOMIC_RELEASE);
 }
 
 int jack_trigger_graph (void *arg) {
 	pprintf (4, "jack-graph trigger..\n");
-	pthread_cond_signal(&jack_trigger_cond);
+	trigger_wakeup(settled ? WAKE_GRAPH : WAKE_TIMEOUT);
+	return 0;
+}
+
+void jack_trigger_client (const char *name, int reg, void *arg) {
+	pprintf (4, "jack-client-registration trigger: %s %s\n", name,
+	    reg ? "registered" : "unregistered");
+	trigger_wakeup(settled && reg ? WAKE_CLIENT : WAKE_TIMEOUT);
+}
+
+int jack_trigger_buffer_size (jack_nframes_t nframes, void *arg) {
+	pprintf (4, "jack-buffer-size trigger: %u\n", nframes);
+	if (settled && nframes != buffer_size)
+		trigger_wakeup(WAKE_BUFSIZE);
+	buffer_size = nframes;
+	return 0;
+}
+
+int jack_trigger_xrun (void *arg) {
+	pprintf (3, "jack-xrun trigger..\n");
+	__atomic_fetch_add(&xrun_count, 1, __ATOMIC_RELAXED);
+	glitch_record(monotonic_ns());
+	trigger_wakeup(WAKE_XRUN);
+	return 0;
+}
+
+/*
+ * Runs in the JACK realtime thread: no locks, no allocation, O(1). The
+ * only syscall is the one wakeup when an idle session's transport starts.
+ */
+int jack_process (jack_nframes_t nframes, void *arg) {
+	jack_nframes_t frames;
+	jack_time_t start, next;
+	float period;
+	int w;
+
+	__atomic_fetch_add(&window_adding, 1, __ATOMIC_SEQ_CST);
+	w = __atomic_load_n(&window_active, __ATOMIC_SEQ_CST);
+	load_hist_add(&window_hist[w], jack_cpu_load(client));
+	__atomic_fetch_sub(&window_adding, 1, __ATOMIC_RELEASE);
+
+	/* an idle session resumes within one period of the transport starting */
+	if (__atomic_load_n(&watch_transport, __ATOMIC_RELAXED)
+	    && jack_transport_query(client, NULL) != JackTransportStopped) {
+		__atomic_store_n(&watch_transport, 0, __ATOMIC_RELAXED);
+		trigger_wakeup(WAKE_TRANSPORT);
+	}
+
+	if (jack_get_cycle_times(client, &frames, &start, &next, &period) == 0) {
+		if (expected_cycle && start > expected_cycle
+		    && start - expected_cycle > period * LATE_CYCLE_FRACTION)
+			glitch_record(monotonic_ns());
+		expected_cycle = next;
+	}
 	return 0;
 }
 
@@ -77,11 +174,24 @@ int jjack_open (const ProcessInfo *jack_server_process) {
 	}
 	pprintf(1, "Connected to the jack server\n");
 
+	load_hist_reset(&window_hist[0]);
+	load_hist_reset(&window_hist[1]);
+	load_hist_reset(&server_hist);
+	settled = 0;
+	expected_cycle = 0;
+	ports_changed = 1;
+	watch_transport = 0;
+	buffer_size = jack_get_buffer_size(client);
+
 	jack_on_shutdown (client, jack_shutdown, 0);
+	jack_set_process_callback(client, jack_process, NULL);
 	jack_set_graph_order_callback(client, jack_trigger_graph, NULL);
-#if 0
+	jack_set_xrun_callback(client, jack_trigger_xrun, NULL);
+	jack_set_client_registration_callback(client, jack_trigger_client, NULL);
+	jack_set_buffer_size_callback(client, jack_trigger_buffer_size, NULL);
 	jack_set_port_connect_callback(client, jack_trigger_port, NULL);
-#endif
+	jack_set_port_registration_callback(client,
+	    jack_trigger_port_registration, NULL);
 
 	if (jack_activate (client)) {
 		restore_privileges();
@@ -96,6 +206,7 @@ int jjack_open (const ProcessInfo *jack_server_process) {
 	sched_yield();
 	usleep(64000); /* guess: one jack period should be enough 1024*3/48k */
 	sched_yield();
+	settled = 1;
 
 	restore_privileges();
 	pprintf (3, "connected to JACKd\n");
@@ -107,12 +218,117 @@ void jjack_close () {
 		jack_deactivate (client);
 		jack_client_close (client);
 		pprintf(1, "Disconnected from the jack server\n");
+		if (server_hist.total)
+			pprintf(1, "DSP load over %u cycles: p50 %.1f%%, p95 %.1f%%, "
+			    "p99 %.1f%%, max %.1f%%\n", server_hist.total,
+			    load_hist_quantile(&server_hist, 0.50),
+			    load_hist_quantile(&server_hist, 0.95),
+			    load_hist_quantile(&server_hist, 0.99),
+			    load_hist_quantile(&server_hist, 1.00));
 	}
 	client=NULL;
 }
 
-float jjack_poll (int filter_uid, int filter_gid, ProcessInfo *jack_server_process)
+/*
+ * Close the current reporting window and return the DSP load statistic
+ * selected by dsp_stat. Falls back to the smoothed jack_cpu_load() if no
+ * cycle has run since the previous call.
+ */
+float jjack_poll ()
 {
-  return client ? jack_cpu_load(client) : 0.0;
+	load_hist_t *closed;
+	int w;
+	float load;
+
+	if (!client)
+		return 0.0;
+
+	w = __atomic_load_n(&window_active, __ATOMIC_RELAXED);
+	__atomic_store_n(&window_active, !w, __ATOMIC_SEQ_CST);
+	/* an add that read the old index may still be running: one add long */
+	while (__atomic_load_n(&window_adding, __ATOMIC_ACQUIRE))
+		;
+	closed = &window_hist[w];
+
+	if (dsp_stat == DSP_STAT_MEAN || !closed->total)
+		load = jack_cpu_load(client);
+	else
+		load = load_hist_quantile(closed, dsp_stat_quantile[dsp_stat]);
+
+	pprintf(4, "dsp window: %u cycles, p50 %.1f%%, p95 %.1f%%, p99 %.1f%%, "
+	    "max %.1f%%\n", closed->total,
+	    load_hist_quantile(closed, 0.50), load_hist_quantile(closed, 0.95),
+	    load_hist_quantile(closed, 0.99), load_hist_quantile(closed, 1.00));
+
+	load_hist_merge(&server_hist, closed);
+	load_hist_reset(closed);
+	return load;
+}
+
+
+/* the duration of one JACK period in usecs, 0 if not connected */
+unsigned int jjack_period_usecs ()
+{
+	jack_nframes_t rate;
+
+	if (!client || !(rate = jack_get_sample_rate(client)))
+		return 0;
+	return (unsigned long long)jack_get_buffer_size(client) * 1000000 / rate;
+}
+
+/* the number of xruns reported by all servers so far */
+unsigned int jjack_xruns ()
+{
+	return __atomic_load_n(&xrun_count, __ATOMIC_RELAXED);
+}
+
+/* the RT priority of the JACK client threads, <= 0 if not realtime */
+int jjack_rt_priority ()
+{
+	if (!client || !jack_is_realtime(client))
+		return 0;
+	return jack_client_real_time_priority(client);
 }
 
+/* whether the transport is rolling or about to */
+int jjack_transport_rolling ()
+{
+	if (!client)
+		return 0;
+	return jack_transport_query(client, NULL) != JackTransportStopped;
+}
+
+/* ask for a WAKE_TRANSPORT wakeup as soon as the transport starts */
+void jjack_watch_transport (int on)
+{
+	__atomic_store_n(&watch_transport, on, __ATOMIC_RELAXED);
+}
+
+/*
+ * The number of connections between ports of clients other than the
+ * hardware (system:) ones, recounted only after the graph changed.
+ */
+int jjack_connections ()
+{
+	const char **ports;
+	int i;
+
+	if (!client)
+		return 0;
+	if (!__atomic_exchange_n(&ports_changed, 0, __ATOMIC_ACQ_REL))
+		return connections;
+
+	connections = 0;
+	if ((ports = jack_get_ports(client, NULL, NULL, 0)) == NULL)
+		return 0;
+	for (i = 0; ports[i]; i++) {
+		jack_port_t *port;
+
+		if (!strncmp(ports[i], "system:", 7))
+			continue;
+		if ((port = jack_port_by_name(client, ports[i])) != NULL)
+			connections += jack_port_connected(port);
+	}
+	jack_free(ports);
+	return connections;
+}
@@ -35,53 +35,39 @@
 #include <grp.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
+#include <getopt.h>
 #include <sys/fsuid.h>
 
 #include "globals.h"
-
-enum modes {
-	LOWER,
-	SAME,
-	RAISE
-};
-
-typedef struct cpustats {
-	unsigned long long user;
-	unsigned long long mynice;
-	unsigned long long system;
-	unsigned long long idle;
-	unsigned long long iowait;
-	unsigned long long irq;
-	unsigned long long softirq;
-} cpustats_t;
-
-typedef struct cpuinfo {
-	unsigned int cpuid;
-	unsigned int nspeeds;
-	unsigned int max_speed;
-	unsigned int min_speed;
-	unsigned int current_speed;
-	unsigned int speed_index;
-	cpustats_t *last_reading;
-	cpustats_t *reading;
-	enum modes current_pstate_mode;
-	int fd;
-	int wfd;
-	char *sysfs_dir;
-	int is_pstate;
-	int in_mhz; /* 0 = speed in kHz, 1 = speed in mHz */
-	unsigned long *freq_table;
-	int table_size;
-	int threads_per_core;
-	int scalable_unit;
-} cpuinfo_t;
-
+#include "cpufreq.h"
+#include "energy.h"
+#include "cpuidle.h"
+#include "rtsched.h"
+#include "glitch.h"
+#include "flightrec.h"
+#include "logger.h"
+#include "governor.h"
+#include "status.h"
+#include "state.h"
+#include "audio_irq.h"
+#include "alsa_load.h"
+#include "turbo.h"
+#include "uncore.h"
+#include "perfsens.h"
+#include "psi.h"
+#include "cgroup_load.h"
+#include "hotplug.h"
+#include "scaling_limits.h"
+#include "shadow.h"
 
 /** globals */
 cpuinfo_t **all_cpus;
+policy_t **policies;
+int npolicies = 0;
 static char buf[1024];
 int run = 1;
-int shutdown = 0;
+int server_shutdown = 0;
 
 /* options */
 int daemonize = 0;
@@ -89,6 +75,28 @@ int verbosity = 0;
 int ignore_nice = 1;
 int use_cpu_load = 0;
 unsigned int poll = 1000; /* in msecs */
+int adaptive_poll = 0;
+unsigned int poll_min = 0;     /* in msecs, 0 - a few JACK periods */
+unsigned int poll_max = 10000; /* in msecs */
+unsigned int boost_window = 0; /* in msecs, 0 - no preemptive boost */
+int async_log = 1;
+
+enum idle_postures {
+	IDLE_OFF,      /* keep governing an idle session */
+	IDLE_MIN,      /* hold the lowest speed */
+	IDLE_KERNEL    /* hand the policies back to a kernel governor */
+};
+int idle_posture = IDLE_OFF;
+unsigned int idle_after = 60; /* in secs */
+
+enum load_sources {
+	LOAD_JACK,     /* the JACK client */
+	LOAD_ALSA,     /* the ALSA PCM status in procfs, no JACK client */
+	LOAD_BOTH      /* the higher of the two, ALSA alone without JACK */
+};
+int load_source = LOAD_JACK;
+const char *procfs_root = "/proc";
+int shadow = 0;
 int jack_reconnect = 0;
 unsigned int highwater_dsp = 50;
 unsigned int lowwater_dsp = 10;
@@ -97,16 +105,144 @@ unsigned int lowwater_cpu = 20;
 unsigned int cores_specified = 0;
 unsigned int step_specified = 0;
 unsigned int step = 100000;  /* in kHz */
+int dsp_stat = DSP_STAT_MEAN;
+int verify_speed_enabled = 1;
+int use_model = 0;
+unsigned int model_target = 0; /* in percent, 0 - between -l and -u */
+
+const char *const dsp_stat_names[] = {
+	"mean", "p50", "p95", "p99", "max", NULL
+};
+
+const char *const cstate_mode_names[] = {
+	"off", "dma", "states", NULL
+};
+
+const char *const idle_posture_names[] = {
+	"off", "min", "kernel", NULL
+};
+
+const char *const load_source_names[] = {
+	"jack", "alsa", "both", NULL
+};
+
+const char *const turbo_mode_names[] = {
+	"keep", "off", "auto", NULL
+};
+
+const char *const uncore_mode_names[] = {
+	"off", "on", "compare", NULL
+};
+
+const char *const actuator_names[] = {
+	"setspeed", "floor", "range", "compare", NULL
+};
+
+const char *const rt_mode_names[] = {
+	"off", "fifo", "deadline", NULL
+};
+
+/* options without a short form */
+enum long_only_options {
+	OPT_DSP_STAT = 256,
+	OPT_CSTATE,
+	OPT_CSTATE_BUDGET,
+	OPT_NO_VERIFY,
+	OPT_MODEL,
+	OPT_MODEL_TARGET,
+	OPT_ADAPTIVE,
+	OPT_POLL_MIN,
+	OPT_POLL_MAX,
+	OPT_RT,
+	OPT_RT_PRIORITY,
+	OPT_BOOST_WINDOW,
+	OPT_GLITCH_WINDOW,
+	OPT_GLITCH_THRESHOLD,
+	OPT_NO_RECORDER,
+	OPT_DECODE,
+	OPT_SYNC_LOG,
+	OPT_NO_STATUS,
+	OPT_NO_STATE,
+	OPT_IDLE_POSTURE,
+	OPT_IDLE_AFTER,
+	OPT_IRQ_FLOOR,
+	OPT_LOAD_SOURCE,
+	OPT_PROCFS_ROOT,
+	OPT_TURBO,
+	OPT_TURBO_DWELL,
+	OPT_UNCORE,
+	OPT_PERF_SENSITIVITY,
+	OPT_PSI,
+	OPT_CGROUP,
+	OPT_ACTUATOR,
+	OPT_SHADOW,
+	OPT_POWER_MODEL
+};
+
+static const struct option long_options[] = {
+	{"dsp-stat", required_argument, NULL, OPT_DSP_STAT},
+	{"cstate", required_argument, NULL, OPT_CSTATE},
+	{"cstate-budget", required_argument, NULL, OPT_CSTATE_BUDGET},
+	{"no-verify", no_argument, NULL, OPT_NO_VERIFY},
+	{"model", no_argument, NULL, OPT_MODEL},
+	{"model-target", required_argument, NULL, OPT_MODEL_TARGET},
+	{"adaptive", no_argument, NULL, OPT_ADAPTIVE},
+	{"poll-min", required_argument, NULL, OPT_POLL_MIN},
+	{"poll-max", required_argument, NULL, OPT_POLL_MAX},
+	{"rt", required_argument, NULL, OPT_RT},
+	{"rt-priority", required_argument, NULL, OPT_RT_PRIORITY},
+	{"boost-window", required_argument, NULL, OPT_BOOST_WINDOW},
+	{"glitch-window", required_argument, NULL, OPT_GLITCH_WINDOW},
+	{"glitch-threshold", required_argument, NULL, OPT_GLITCH_THRESHOLD},
+	{"no-recorder", no_argument, NULL, OPT_NO_RECORDER},
+	{"decode", required_argument, NULL, OPT_DECODE},
+	{"sync-log", no_argument, NULL, OPT_SYNC_LOG},
+	{"no-status", no_argument, NULL, OPT_NO_STATUS},
+	{"no-state", no_argument, NULL, OPT_NO_STATE},
+	{"idle-posture", required_argument, NULL, OPT_IDLE_POSTURE},
+	{"idle-after", required_argument, NULL, OPT_IDLE_AFTER},
+	{"irq-floor", required_argument, NULL, OPT_IRQ_FLOOR},
+	{"load-source", required_argument, NULL, OPT_LOAD_SOURCE},
+	{"procfs-root", required_argument, NULL, OPT_PROCFS_ROOT},
+	{"turbo", required_argument, NULL, OPT_TURBO},
+	{"turbo-dwell", required_argument, NULL, OPT_TURBO_DWELL},
+	{"uncore", required_argument, NULL, OPT_UNCORE},
+	{"perf-sensitivity", required_argument, NULL, OPT_PERF_SENSITIVITY},
+	{"psi", required_argument, NULL, OPT_PSI},
+	{"cgroup", required_argument, NULL, OPT_CGROUP},
+	{"actuator", required_argument, NULL, OPT_ACTUATOR},
+	{"shadow", no_argument, NULL, OPT_SHADOW},
+	{"power-model", required_argument, NULL, OPT_POWER_MODEL},
+	{NULL, 0, NULL, 0}
+};
 
 pthread_mutex_t poll_wait_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t  jack_trigger_cond = PTHREAD_COND_INITIALIZER;
 
+/* pending wakeup reasons and the time of the first pending event */
+static int wake_reasons = WAKE_TIMEOUT;
+static long long wake_event_ns = 0;
+
 /* statistics */
 unsigned int change_speed_count = 0;
+unsigned int wakeup_count = 0;
+unsigned int reaction_count = 0;
+double reaction_sum_ms = 0;
+double reaction_max_ms = 0;
+unsigned int drift_count = 0;
+unsigned int edit_count = 0;
+unsigned int edit_xruns = 0;
+unsigned int boost_count = 0;
+unsigned int boost_kept = 0;
+unsigned int idle_count = 0;
+energy_acct_t idle_acct;
+unsigned int pruned_count = 0;
 time_t start_time = 0;
 
 #define SYSFS_TREE "/sys/devices/system/cpu/"
 #define SYSFS_SETSPEED "scaling_setspeed"
+#define SYSFS_CURSPEED "scaling_cur_freq"
+#define SYSFS_CPUINFO_CURSPEED "cpuinfo_cur_freq"
 #define SYSFS_PSTATE_MODE "scaling_governor"
 #define PSTATE_MODE_POWERSAVE "powersave"
 #define PSTATE_MODE_PERFORMANCE "performance"
@@ -136,33 +272,146 @@ void help(void) {
 	printf(" -w        wait for and re-connect to jackd.\n");
 	printf(" -j <uid>  user-name or UID of jackd process (default: autodetect)\n");
 	printf(" -J <gid>  group-name or GID of jackd process (default: autodetect)\n");
+	printf(" --dsp-stat <mean|p50|p95|p99|max>\n");
+	printf("           DSP load statistic of the per-cycle samples compared\n");
+	printf("           with -u/-l (default: mean, the JACK smoothed load)\n");
+	printf(" --cstate <off|dma|states>\n");
+	printf("           Limit idle state exit latency while JACK is busy, through\n");
+	printf("           /dev/cpu_dma_latency or cpuidle/stateN/disable (default: off)\n");
+	printf(" --cstate-budget #\n");
+	printf("           Allowed exit latency in percent of the JACK period\n");
+	printf("           [0 .. 100, default 10]\n");
+	printf(" --no-verify\n");
+	printf("           Don't read back the frequency after setting it\n");
+	printf(" --model   Learn how DSP load scales with frequency and jump to\n");
+	printf("           the lowest frequency predicted to meet the target\n");
+	printf(" --model-target #\n");
+	printf("           DSP load the model aims at [0 .. 100, default (-l + -u)/2]\n");
+	printf(" --adaptive\n");
+	printf("           Poll faster near the upper limit, slower when idle\n");
+	printf(" --poll-min #\n");
+	printf("           Shortest adaptive poll in msecs (default: 4 JACK periods)\n");
+	printf(" --poll-max #\n");
+	printf("           Longest adaptive poll in msecs (default = 10000)\n");
+	printf(" --rt off|fifo|deadline\n");
+	printf("           Scheduling of the governor (default = off: nice 5)\n");
+	printf(" --rt-priority #\n");
+	printf("           SCHED_FIFO priority, kept below JACK's (default = lowest)\n");
+	printf(" --boost-window #\n");
+	printf("           Raise the JACK cpus for # msecs on graph, client and\n");
+	printf("           buffer size changes (default = 0: off)\n");
+	printf(" --glitch-window #\n");
+	printf("           Msecs after a speed change its glitches are blamed on\n");
+	printf("           (default = 100)\n");
+	printf(" --glitch-threshold #\n");
+	printf("           Lock the speed of a policy while JACK runs when this\n");
+	printf("           percentage of its changes glitch (default = 0: off)\n");
+	printf(" --no-recorder\n");
+	printf("           Don't keep the flight recorder of the last %d events\n",
+			FLIGHTREC_ENTRIES);
+	printf(" --decode file\n");
+	printf("           Print a flight recorder dump and exit\n");
+	printf(" --sync-log\n");
+	printf("           Write log messages from the governor thread itself\n");
+	printf(" --no-status\n");
+	printf("           Don't publish the status page %s\n", JFD_STATUS_PATH);
+	printf(" --no-state\n");
+	printf("           Don't keep the learned state in %s\n", STATE_FILE);
+	printf(" --idle-posture off|min|kernel\n");
+	printf("           What to do while the session is idle (default = off)\n");
+	printf(" --idle-after #\n");
+	printf("           Secs without transport, connections and load before\n");
+	printf("           the session counts as idle (default = 60)\n");
+	printf(" --irq-floor #\n");
+	printf("           Lowest speed in percent of the max for the cpus handling\n");
+	printf("           the sound card interrupts (default = 0, no floor)\n");
+	printf(" --load-source jack|alsa|both\n");
+	printf("           Read the DSP load from a JACK client, from the ALSA\n");
+	printf("           PCM status in procfs, or both (default = jack)\n");
+	printf(" --procfs-root <dir>\n");
+	printf("           Read the ALSA and interrupt status below dir\n");
+	printf("           (default = /proc)\n");
+	printf(" --turbo keep|off|auto\n");
+	printf("           Turbo while audio runs: as found, never, or only for loads\n");
+	printf("           the max speed can't sustain (default = auto)\n");
+	printf(" --turbo-dwell #\n");
+	printf("           Least msecs between two turbo switches (default = 5000)\n");
+	printf(" --uncore off|on|compare\n");
+	printf("           Govern the uncore frequency with the DSP load, or alternate\n");
+	printf("           that with core-only minutes to compare (default = off)\n");
+	printf(" --perf-sensitivity #\n");
+	printf("           Stop raising the speed when less than # percent of the JACK\n");
+	printf("           threads' time scales with it (default = 0, off)\n");
+	printf(" --psi #\n");
+	printf("           Raise the speed at once when tasks stall # msecs for the\n");
+	printf("           cpu within 500 msecs (default = 0, off)\n");
+	printf(" --cgroup <path>|auto\n");
+	printf("           Measure the CPU load (-P, implied) of this cgroup v2, or of\n");
+	printf("           the JACK server's, on its effective cpus\n");
+	printf(" --actuator setspeed|floor|range|compare\n");
+	printf("           Set the speed with the userspace governor, or keep the kernel\n");
+	printf("           governor and move only its floor, or floor and ceiling, or\n");
+	printf("           alternate setspeed and floor minutes (default = setspeed)\n");
+	printf(" --shadow\n");
+	printf("           Decide, but leave speeds, governors and all other knobs to\n");
+	printf("           the system; report the speeds and energy decided against\n");
+	printf("           what the kernel governor did\n");
+	printf(" --power-model <file>\n");
+	printf("           The power model of --shadow, as for jackfreqd-tune -m\n");
 	printf("\n");
 	return;
 }
 
 /**
- * Open a file and copy it's first 1024 bytes into the global "buf".
- * Zero terminate the buffer. 
+ * Look up a keyword option argument.
+ * @param names NULL terminated list of the accepted keywords
+ * @return the index of arg in names or -1 if not found
  */
-int read_file(const char *file, int fd, int new) {
+int parse_keyword(const char *arg, const char *const *names) {
+	int i;
+
+	for (i = 0; names[i]; i++)
+		if (strcmp(arg, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+long long monotonic_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void trigger_wakeup(int reason) {
+	long long none = 0;
+
+	__atomic_fetch_or(&wake_reasons, reason, __ATOMIC_RELAXED);
+	__atomic_compare_exchange_n(&wake_event_ns, &none, monotonic_ns(),
+			0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	pthread_cond_signal(&jack_trigger_cond);
+}
+
+/**
+ * Open a file and copy up to size-1 bytes of it into dst.
+ * Zero terminate the buffer. Reentrant and silent: returns errno on
+ * failure and leaves reporting to the caller.
+ */
+int read_file_to(const char *file, int fd, int new, char *dst, size_t size) {
 	int n, err;
 	
 	if (new) {
-		if ((fd = open(file, O_RDONLY)) == -1) {
-			err = errno;
-			perror(file);
-			return err;
-		}
+		if ((fd = open(file, O_RDONLY)) == -1)
+			return errno;
 	}
 	
-	lseek(fd, 0, SEEK_SET);
-	if ((n = read(fd, buf, sizeof(buf)-1)) < 0) {
+	if ((n = pread(fd, dst, size-1, 0)) < 0) {
 		err = errno;
-		perror(file);
-		close(fd);
+		if (new)
+			close(fd);
 		return err;
 	}
-	buf[n] = '\0';
+	dst[n] = '\0';
 
 	if (new)
 		close(fd);
@@ -170,63 +419,242 @@ int read_file(const char *file, int fd, int new) {
 	return 0;
 }
 
-int set_speed(cpuinfo_t *cpu) {
-	cpuinfo_t *save;
+/**
+ * Open a file and copy it's first 1024 bytes into the global "buf".
+ * Zero terminate the buffer. 
+ */
+int read_file(const char *file, int fd, int new) {
+	int err;
+
+	if ((err = read_file_to(file, fd, new, buf, sizeof(buf))) != 0) {
+		errno = err;
+		perror(file);
+	}
+	return err;
+}
+
+/**
+ * Write a string into a (sysfs) file.
+ * @return 0 or errno
+ */
+int write_file(const char *file, const char *str) {
+	int fd, err = 0;
+	ssize_t len;
+
+	if (shadow) {
+		pprintf(4, "shadow: %s <- %s", file, str);
+		return 0;
+	}
+	if ((fd = open(file, O_WRONLY)) < 0)
+		return errno;
+	if ((len = write(fd, str, strlen(str))) < 0)
+		err = errno;
+	else if (len != strlen(str))
+		err = EPIPE;
+	close(fd);
+	return err;
+}
+
+/*
+ * Number of consecutive reads of a different speed before we believe
+ * somebody else changed it, and number of requests of a table entry that
+ * is never observed before the entry is dropped.
+ */
+#define DRIFT_CONFIRM_READS 2
+#define PRUNE_MISSES 5
+
+/**
+ * Read the speed the cpu actually runs at.
+ * @return the speed in kHz or 0 if unknown
+ */
+unsigned long read_cur_speed(policy_t *pol) {
+	char str[32];
+
+	if (pol->cur_fd <= 0 || read_file_to(NULL, pol->cur_fd, 0, str, sizeof(str)))
+		return 0;
+	return strtoul(str, NULL, 10);
+}
+
+/* the table entry closest to speed */
+int nearest_speed_index(policy_t *pol, unsigned long speed) {
+	int i, best = 0;
+	unsigned long d, best_d = (unsigned long)-1;
+
+	for (i = 0; i < pol->table_size; i++) {
+		d = (pol->freq_table[i] > speed) ?
+			pol->freq_table[i] - speed : speed - pol->freq_table[i];
+		if (d < best_d) {
+			best_d = d;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/* derive the speeds of a policy from its table and speed_index */
+void sync_policy_speed(policy_t *pol) {
+	pol->current_speed = pol->freq_table[pol->speed_index];
+	pol->max_speed = pol->freq_table[0];
+	pol->min_speed = pol->freq_table[pol->table_size-1];
+}
+
+/* drop a table entry the driver never runs at */
+void remove_speed(policy_t *pol, int index) {
+	int n = pol->table_size - index - 1;
+
+	memmove(&pol->freq_table[index], &pol->freq_table[index+1],
+			n * sizeof(unsigned long));
+	memmove(&pol->freq_hits[index], &pol->freq_hits[index+1], n);
+	memmove(&pol->freq_misses[index], &pol->freq_misses[index+1], n);
+	memmove(&pol->model_residual[index], &pol->model_residual[index+1],
+			n * sizeof(float));
+	pol->table_size--;
+	if (pol->speed_index > index || pol->speed_index >= pol->table_size)
+		pol->speed_index--;
+	/* the speed to drop back to after a boost moves along */
+	if (pol->boost_saved_index > index
+			|| pol->boost_saved_index >= pol->table_size)
+		pol->boost_saved_index--;
+}
+
+void prune_speed(policy_t *pol, int index) {
+	if (pol->table_size <= 1)
+		return;
+
+	pprintf(1, "policy%d: %luMhz never takes effect, removing it\n",
+			pol->id, pol->freq_table[index] / 1000);
+	remove_speed(pol, index);
+	pruned_count++;
+}
+
+/**
+ * Compare the speed we believe a policy runs at with what the
+ * driver reports. Called once per poll: on the tick after a transition
+ * (verify_pending set), once the speed had time to settle, and to catch
+ * changes made by firmware or other tools.
+ */
+void verify_speed(policy_t *pol) {
+	unsigned long cur;
+	int idx, requested = pol->speed_index;
+
+	/* the kernel governor may run anywhere above the floor */
+	if (!verify_speed_enabled || pol->is_pstate || pol->in_mhz
+			|| limits_active() != ACTUATE_SETSPEED || shadow)
+		return;
+	if ((cur = read_cur_speed(pol)) == 0)
+		return;
+
+	idx = nearest_speed_index(pol, cur);
+	if (pol->freq_hits[idx] < 255)
+		pol->freq_hits[idx]++;
+	/* the turbo entry, held back by the knob: neither a miss nor drift */
+	if (requested == 0 && idx == 1 && turbo_managed())
+		idx = 0;
+
+	if (pol->verify_pending) {
+		pol->verify_pending = 0;
+		if (idx == requested) {
+			pol->freq_misses[requested] = 0;
+		} else if (pol->freq_misses[requested] < 255) {
+			pol->freq_misses[requested]++;
+			pprintf(3, "policy%d: requested %luMhz, running at %luMhz\n",
+					pol->id, pol->freq_table[requested] / 1000, cur / 1000);
+			if (pol->freq_misses[requested] >= PRUNE_MISSES
+					&& !pol->freq_hits[requested]) {
+				prune_speed(pol, requested);
+				idx = nearest_speed_index(pol, cur);
+			}
+		}
+	}
+
+	if (idx == pol->speed_index) {
+		pol->drift_reads = 0;
+	} else if (++pol->drift_reads >= DRIFT_CONFIRM_READS) {
+		pprintf(2, "policy%d: running at %luMhz instead of %luMhz, resynchronizing\n",
+				pol->id, cur / 1000, pol->freq_table[pol->speed_index] / 1000);
+		pol->speed_index = idx;
+		pol->drift_reads = 0;
+		drift_count++;
+	}
+	sync_policy_speed(pol);
+}
+
+int set_speed(policy_t *pol) {
 	int err=0;
-	int len, i;
+	int len;
 	char writestr[100];
-	/* 
-	 * We need to set the current speed on all virtual CPUs that fall
-	 * into this CPU's scalable unit.
-	 */
-	save = cpu;
-	for (i = save->cpuid; i < (save->cpuid + save->threads_per_core); i++) {
-		cpu = all_cpus[i];
-		cpu->current_speed = save->freq_table[save->speed_index];
-	}
-	cpu = save;
+	long long write_start;
+
+	/* all cpus of the policy share current_speed */
+	pol->current_speed = pol->freq_table[pol->speed_index];
 
-	pprintf(3,"Setting speed to %d\n", cpu->current_speed);
+	pprintf(3,"Setting speed to %d\n", pol->current_speed);
 
 	change_speed_count++;
 
-	strncpy(writestr, cpu->sysfs_dir, 50);
+	if (shadow)
+		return 0;
+	if (limits_active() != ACTUATE_SETSPEED) {
+		write_start = monotonic_ns();
+		err = limits_set(pol);
+		pol->write_latency_ns = monotonic_ns() - write_start;
+		if (!err) {
+			pol->last_change_ns = monotonic_ns();
+			glitch_transition(pol, pol->last_change_ns);
+		}
+		return err;
+	}
+
+	strncpy(writestr, pol->sysfs_dir, 50);
 	strncat(writestr, SYSFS_SETSPEED, 20);
 	
-	if ((cpu->wfd = open(writestr, O_WRONLY)) < 0) {
+	if ((pol->wfd = open(writestr, O_WRONLY)) < 0) {
 		err = errno;
 		perror("Can't open scaling_setspeed /sys/ device.");
 		return err;
 	}
 
-	lseek(cpu->wfd, 0, SEEK_CUR);
+	lseek(pol->wfd, 0, SEEK_CUR);
 	
-	sprintf(writestr, "%d\n", (cpu->in_mhz) ?
-			(cpu->current_speed / 1000) : cpu->current_speed); 
+	sprintf(writestr, "%d\n", (pol->in_mhz) ?
+			(pol->current_speed / 1000) : pol->current_speed); 
 
 	pprintf(4,"str=%s", writestr);
 	
-	if ((len = write(cpu->wfd, writestr, strlen(writestr))) < 0) {
+	write_start = monotonic_ns();
+	if ((len = write(pol->wfd, writestr, strlen(writestr))) < 0) {
 		err = errno;
 		perror("Could not write to scaling_setspeed sys-fs\n");
 	}
+	pol->write_latency_ns = monotonic_ns() - write_start;
 
 	if (len != strlen(writestr)) {
 		pprintf(0, "ERROR Incomplete write to scaling_setspeed.\n");
 		err=EPIPE;
 	}
 
-	close(cpu->wfd);
-	cpu->wfd=0;
+	close(pol->wfd);
+	pol->wfd=0;
+
+	if (!err) {
+		pol->last_change_ns = monotonic_ns();
+		glitch_transition(pol, pol->last_change_ns);
+		/*
+		 * scaling_cur_freq averages over the last few msecs on x86:
+		 * read back on the next tick, not now
+		 */
+		pol->verify_pending = 1;
+	}
 
 	return err;
 }
 
-int set_pstate_mode(cpuinfo_t *cpu, enum modes mode) {
+int set_pstate_mode(policy_t *pol, enum modes mode) {
   int err=0;
   int len;
   const char* new_pstate_mode = NULL;
   char writestr[100];
+  long long write_start;
 
   switch (mode) {
     case LOWER:
@@ -241,37 +669,72 @@ int set_pstate_mode(cpuinfo_t *cpu, enum modes mode) {
   if (new_pstate_mode) {
     pprintf(3,"Setting mode to %s\n", new_pstate_mode);
 
-    cpu->current_pstate_mode = mode;
+    pol->current_pstate_mode = mode;
 
     change_speed_count++;
+    if (shadow)
+      return 0;
 
-    strncpy(writestr, cpu->sysfs_dir, 50);
+    strncpy(writestr, pol->sysfs_dir, 50);
     strncat(writestr, SYSFS_PSTATE_MODE, 20);
 
-    if ((cpu->wfd = open(writestr, O_WRONLY)) < 0) {
+    if ((pol->wfd = open(writestr, O_WRONLY)) < 0) {
 	    err = errno;
 	    perror("Can't open " SYSFS_PSTATE_MODE " /sys/ device.");
 	    return err;
     }
 
-    lseek(cpu->wfd, 0, SEEK_CUR);
+    lseek(pol->wfd, 0, SEEK_CUR);
 
-    if ((len = write(cpu->wfd, new_pstate_mode, strlen(new_pstate_mode))) < 0) {
+    write_start = monotonic_ns();
+    if ((len = write(pol->wfd, new_pstate_mode, strlen(new_pstate_mode))) < 0) {
 	    err = errno;
 	    perror("Could not write to " SYSFS_PSTATE_MODE " sys-fs\n");
     }
+    pol->write_latency_ns = monotonic_ns() - write_start;
 
     if (len != strlen(new_pstate_mode)) {
 	    pprintf(0, "ERROR Incomplete write to " SYSFS_PSTATE_MODE ".\n");
 	    err=EPIPE;
     }
 
-    close(cpu->wfd);
-    cpu->wfd=0;
+    if (!err) {
+	    pol->last_change_ns = monotonic_ns();
+	    glitch_transition(pol, pol->last_change_ns);
+    }
+
+    close(pol->wfd);
+    pol->wfd=0;
   }
   return err;
 }
 
+int set_governor(policy_t *pol, const char *governor) {
+	char path[100], str[100];
+
+	snprintf(path, sizeof(path), "%sscaling_governor", pol->sysfs_dir);
+	snprintf(str, sizeof(str), "%s\n", governor);
+	return write_file(path, str);
+}
+
+#define KERNEL_GOVERNORS "schedutil", "ondemand", "conservative"
+
+/* the first kernel governor the policy offers */
+int hand_back(policy_t *pol) {
+	static const char *const governors[] = {KERNEL_GOVERNORS, NULL};
+	char path[100], avail[512];
+	int i;
+
+	snprintf(path, sizeof(path), "%sscaling_available_governors",
+			pol->sysfs_dir);
+	if (read_file_to(path, 0, 1, avail, sizeof(avail)) != 0)
+		return ENOENT;
+	for (i = 0; governors[i]; i++)
+		if (strstr(avail, governors[i]))
+			return set_governor(pol, governors[i]);
+	return ENOENT;
+}
+
 /*
  * Reads /proc/stat into buf, and parses the output.
  *
@@ -345,24 +808,137 @@ float calc_stat(cpuinfo_t *cpu) {
 	return pct;
 }
 
-int change_speed(cpuinfo_t *cpu, enum modes mode) {
-	if (cpu->cpuid != cpu->scalable_unit) 
-		return 0;
-	
+/********************************************************************/
+
+/*
+ * Online model of the DSP load as a function of frequency.
+ *
+ * The work of one period is assumed constant, so the load scales with
+ * 1/frequency. Caches, memory and the uncore don't scale with the core
+ * clock, so each table entry learns a residual: the ratio between the
+ * load observed at that speed and the pure 1/f prediction.
+ */
+#define MODEL_WORK_GAIN 0.5
+#define MODEL_RESIDUAL_GAIN 0.1
+#define MODEL_MIN_LOAD 1.0 /* residuals of lower loads are mostly noise */
+
+int model_ready(policy_t *pol) {
+	return use_model && !pol->is_pstate && pol->model_samples;
+}
+
+float model_predict(policy_t *pol, int index) {
+	return pol->model_work * pol->model_residual[index]
+		/ pol->freq_table[index];
+}
+
+/**
+ * Feed the DSP load observed at the policy's current speed into the model
+ * and choose the lowest speed predicted to keep the load under
+ * model_target.
+ */
+void model_update(policy_t *pol, float dspload) {
+	unsigned long cur;
+	int i = pol->speed_index;
+	double work;
+
+	if (!use_model || pol->is_pstate)
+		return;
+
+	/* the load was measured at the speed the kernel picked */
+	if (shadow && (cur = read_cur_speed(pol)) != 0)
+		i = nearest_speed_index(pol, cur);
+	work = dspload * pol->freq_table[i];
+
+	if (!pol->model_samples) {
+		pol->model_work = work / pol->model_residual[i];
+	} else {
+		if (dspload >= MODEL_MIN_LOAD && pol->model_work > 0)
+			pol->model_residual[i] += MODEL_RESIDUAL_GAIN
+				* (work / pol->model_work - pol->model_residual[i]);
+		pol->model_work += MODEL_WORK_GAIN
+			* (work / pol->model_residual[i] - pol->model_work);
+	}
+	pol->model_samples++;
+
+	for (i = pol->table_size - 1; i > 0; i--)
+		if (model_predict(pol, i) <= model_target)
+			break;
+	pol->target_index = i;
+
+	pprintf(4, "model: policy%d work=%.0f -> %luMhz, predicted load %.1f%%\n",
+			pol->id, pol->model_work, pol->freq_table[i] / 1000,
+			model_predict(pol, i));
+}
+
+/*
+ * Frequency sensitivity: the share of the JACK threads' time that scales
+ * with 1/f, from their perf counters. The load at another speed f is then
+ * load * (sensitivity * f_now / f + 1 - sensitivity). Below perf_sens_pct
+ * the speed goes to the lowest entry predicted to give a load equivalent
+ * to the max speed's, or one within the DSP limits.
+ */
+#define SENS_EQUIV_PCT 5
+
+static float freq_sensitivity = -1;
+
+int freq_insensitive(void) {
+	return perf_sens_pct && freq_sensitivity >= 0
+		&& freq_sensitivity * 100 < perf_sens_pct;
+}
+
+/* the speed of the fastest table-driven policy, 0 - none */
+unsigned long jack_khz(void) {
+	unsigned long khz = 0;
+	int i;
+
+	for (i = 0; i < npolicies; i++)
+		if (!policies[i]->is_pstate
+				&& policies[i]->freq_table[policies[i]->speed_index] > khz)
+			khz = policies[i]->freq_table[policies[i]->speed_index];
+	return khz;
+}
+
+void sensitivity_target(policy_t *pol, float dspload) {
+	float s = freq_sensitivity, now_khz, goal, at_max;
+	int i;
+
+	pol->sens_limited = 0;
+	if (pol->is_pstate || !freq_insensitive())
+		return;
+
+	now_khz = pol->freq_table[pol->speed_index];
+	at_max = dspload * (s * now_khz / pol->freq_table[0] + 1 - s);
+	goal = model_target ? model_target : (highwater_dsp + lowwater_dsp) / 2.0;
+	if (at_max * (100 + SENS_EQUIV_PCT) / 100 > goal)
+		goal = at_max * (100 + SENS_EQUIV_PCT) / 100;
+	for (i = pol->table_size - 1; i > 0; i--)
+		if (dspload * (s * now_khz / pol->freq_table[i] + 1 - s) <= goal)
+			break;
+	pol->target_index = i;
+	pol->sens_limited = 1;
+	pprintf(4, "sensitivity %.2f: policy%d -> %luMhz\n", s, pol->id,
+			pol->freq_table[i] / 1000);
+}
+
+int change_speed(policy_t *pol, enum modes mode) {
 	pprintf(4,"change_speed: mode=%d\n", mode);
 
 	int res;
 	
-	if (cpu->is_pstate) {
-	  res = set_pstate_mode(cpu, mode);
+	if (pol->is_pstate) {
+	  res = set_pstate_mode(pol, mode);
 	} else {
-	  if (mode == RAISE) {
-		  cpu->speed_index = 0;
+	  if (model_ready(pol) || pol->sens_limited) {
+		  pol->speed_index = pol->target_index;
 	  } else {
-		  if (cpu->speed_index != (cpu->table_size-1))
-			  cpu->speed_index++;
+		  pol->speed_index = governor_next_index(mode,
+				  pol->speed_index, pol->table_size);
 	  }
-	  res = set_speed(cpu);
+	  /* the audio interrupt cpus stay at or above their floor */
+	  if (pol->irq_floor_index >= 0
+			  && pol->speed_index > (unsigned int)pol->irq_floor_index)
+		  pol->speed_index = pol->irq_floor_index;
+	  res = set_speed(pol);
 	}
 	
 	return res;
@@ -383,81 +959,90 @@ int faked_compare(const void *a, const void *b) {
 }
 
 /**
- * Allocates and initialises the per-cpu data structures.
+ * Reads the cpufreq data of a policy and switches it to the userspace
+ * governor. Touches nothing but the policy itself, so independent
+ * policies may be initialised in parallel.
  */
-int get_per_cpu_info(cpuinfo_t *cpu, int cpuid) {
-	char cpustr[100], scratch[100], tmp[11], *p1;
-	int fd, err;
+int get_policy_info(policy_t *pol) {
+	char cpustr[100], scratch[100], fbuf[1024], *p1;
+	int err;
 	unsigned long temp;
+	unsigned int pstep = step;
 	
-	cpu->cpuid = cpuid;
-	cpu->sysfs_dir = (char *)malloc(50*sizeof(char));
-	if (cpu->sysfs_dir == NULL) {
-		perror("Couldn't allocate per-cpu sysfs_dir");
+	pol->sysfs_dir = (char *)malloc(50*sizeof(char));
+	if (pol->sysfs_dir == NULL) {
+		perror("Couldn't allocate per-policy sysfs_dir");
 		return ENOMEM;
 	}
-	memset(cpu->sysfs_dir, 0, (50*sizeof(char)));
+	memset(pol->sysfs_dir, 0, (50*sizeof(char)));
 
-	strncpy(cpu->sysfs_dir, SYSFS_TREE, 30);
-	sprintf(cpustr, "cpu%d/cpufreq/", cpuid);
-	strncat(cpu->sysfs_dir, cpustr, 20);
+	strncpy(pol->sysfs_dir, SYSFS_TREE, 30);
+	sprintf(cpustr, "cpu%d/cpufreq/", pol->id);
+	strncat(pol->sysfs_dir, cpustr, 20);
 	
-	strncpy(scratch, cpu->sysfs_dir, 50);
+	strncpy(scratch, pol->sysfs_dir, 50);
 	strncat(scratch, "cpuinfo_max_freq", 18);
-	if ((err = read_file(scratch, 0, 1)) != 0) {
+	if ((err = read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf))) != 0) {
+		errno = err;
+		perror(scratch);
 		return err;
 	}
 	
-	cpu->max_speed = strtol(buf, NULL, 10);
+	pol->max_speed = strtol(fbuf, NULL, 10);
 	
-	strncpy(scratch, cpu->sysfs_dir, 50);
+	strncpy(scratch, pol->sysfs_dir, 50);
 	strncat(scratch, "cpuinfo_min_freq", 18);
 
-	if ((err = read_file(scratch, 0, 1)) != 0) {
+	if ((err = read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf))) != 0) {
+		errno = err;
+		perror(scratch);
 		return err;
 	}
 
-	cpu->min_speed = strtol(buf, NULL, 10);
+	pol->min_speed = strtol(fbuf, NULL, 10);
 
 	/* 
 	 * More error handling, make sure step is not larger than the 
 	 * difference between max and min speeds. If so, truncate it.
 	 */
-	if (step > (cpu->max_speed - cpu->min_speed)) {
-		step = cpu->max_speed - cpu->min_speed;
+	if (pstep > (pol->max_speed - pol->min_speed)) {
+		pstep = pol->max_speed - pol->min_speed;
 	}
 	
-	/* XXXjc read the real current speed */
-	cpu->current_speed = cpu->max_speed;
-	cpu->speed_index = 0;
+	pol->current_speed = pol->max_speed;
+	pol->speed_index = 0;
 
-	strncpy(scratch, cpu->sysfs_dir, 50);
+	strncpy(scratch, pol->sysfs_dir, 50);
 	strncat(scratch, "scaling_available_frequencies", 50);
 
-	if (((err = read_file(scratch, 0, 1)) != 0) || (step_specified)) {
+	if (((err = read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf))) != 0)
+			|| (step_specified) || !pstep) {
 		/* 
 		 * We don't have scaling_available_frequencies. build the
 		 * table from the min, max, and step values.  the driver
 		 * could ignore these, but we'll represent it this way since
 		 * we don't have any other info.
 		 */
-		cpu->table_size = ((cpu->max_speed-cpu->min_speed)/step) + 1;
-		cpu->table_size += ((cpu->max_speed-cpu->min_speed)%step)?1:0;
+		pol->table_size = 1;
+		if (pstep) {
+			pol->table_size += (pol->max_speed-pol->min_speed)/pstep;
+			pol->table_size += ((pol->max_speed-pol->min_speed)%pstep)?1:0;
+		}
 		
-		cpu->freq_table = (unsigned long *)
-			malloc(cpu->table_size*sizeof(unsigned long));
+		pol->freq_table = (unsigned long *)
+			malloc(pol->table_size*sizeof(unsigned long));
 
-		if (cpu->freq_table == (unsigned long *)NULL) {
-			perror("couldn't allocate cpu->freq_table");
+		if (pol->freq_table == (unsigned long *)NULL) {
+			perror("couldn't allocate pol->freq_table");
 			return ENOMEM;
 		}
 
 		/* populate the table.  Start at the top, and subtract step */
-		for (temp = 0; temp < cpu->table_size; temp++) {
-			cpu->freq_table[temp] = 
-			((cpu->min_speed<(cpu->max_speed-(temp*step))) ? 
-			 (cpu->max_speed-(temp*step)) :
-			 (cpu->min_speed) );
+		for (temp = 0; temp < pol->table_size; temp++) {
+			pol->freq_table[temp] = 
+			((pol->min_speed<(pol->max_speed-(temp*pstep))) ? 
+			 (pol->max_speed-(temp*pstep)) :
+			 (pol->min_speed) );
 		}	
 	} else {
 		/* 
@@ -470,147 +1055,1001 @@ int get_per_cpu_info(cpuinfo_t *cpu, int cpuid) {
 		 * return 0 if it can't find anything, and that 0 will never 
 		 * be a real value for the available frequency. 
 		 */
-		p1 = buf;
+		p1 = fbuf;
 		
 		temp = strtoul(p1, &p1, 10);
-		while((temp > 0) && (cpu->table_size < 100)) {
-			cpu->table_size++;
+		while((temp > 0) && (pol->table_size < 100)) {
+			pol->table_size++;
 			temp = strtoul(p1, &p1, 10);
 		}
 	
-		cpu->freq_table = (unsigned long *)
-			malloc(cpu->table_size*sizeof(unsigned long));
-		if (cpu->freq_table == (unsigned long *)NULL) {
-			perror("Couldn't allocate cpu->freq_table\n");
+		pol->freq_table = (unsigned long *)
+			malloc(pol->table_size*sizeof(unsigned long));
+		if (pol->freq_table == (unsigned long *)NULL) {
+			perror("Couldn't allocate pol->freq_table\n");
 			return ENOMEM;
 		}
 	
-		p1 = buf;
-		for (temp = 0; temp < cpu->table_size; temp++) {
-			cpu->freq_table[temp] = strtoul(p1, &p1, 10);
+		p1 = fbuf;
+		for (temp = 0; temp < pol->table_size; temp++) {
+			pol->freq_table[temp] = strtoul(p1, &p1, 10);
+		}
+	}
+
+	/* now lets sort the table just to be sure */
+	qsort(pol->freq_table, pol->table_size, sizeof(unsigned long), 
+			&faked_compare);
+
+	pol->freq_hits = (unsigned char *)calloc(pol->table_size, 1);
+	pol->freq_misses = (unsigned char *)calloc(pol->table_size, 1);
+	pol->model_residual = (float *)malloc(pol->table_size*sizeof(float));
+	if (pol->freq_hits == NULL || pol->freq_misses == NULL
+			|| pol->model_residual == NULL) {
+		perror("Couldn't allocate pol->freq_hits");
+		return ENOMEM;
+	}
+	for (temp = 0; temp < pol->table_size; temp++)
+		pol->model_residual[temp] = 1.0;
+
+	/* start from the speed the policy really runs at */
+	strncpy(scratch, pol->sysfs_dir, 50);
+	strncat(scratch, SYSFS_CURSPEED, 20);
+	if ((pol->cur_fd = open(scratch, O_RDONLY)) < 0) {
+		strncpy(scratch, pol->sysfs_dir, 50);
+		strncat(scratch, SYSFS_CPUINFO_CURSPEED, 20);
+		pol->cur_fd = open(scratch, O_RDONLY);
+	}
+	if ((temp = read_cur_speed(pol)) != 0) {
+		pol->speed_index = nearest_speed_index(pol, temp);
+		pol->current_speed = pol->freq_table[pol->speed_index];
+	}
+	
+	pol->is_pstate = 0;
+	strncpy(scratch, pol->sysfs_dir, 50);
+	strncat(scratch, "scaling_driver", 20);
+
+	if (read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf)) == 0) {
+	  if (strncmp(fbuf, "intel_pstate", 12) == 0) {
+	    pol->is_pstate = 1;
+	    pol->current_pstate_mode = SAME;
+	  }
+	}
+
+	/* the governor is none of our business in shadow mode */
+	if (! pol->is_pstate && ! shadow) {
+		strncpy(scratch, pol->sysfs_dir, 50);
+		strncat(scratch, "scaling_governor", 20);
+
+		if ((err = read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf))) != 0) {
+			errno = err;
+			perror("couldn't open scaling_governors file");
+			return err;
+		}
+
+		limits_save(pol);
+		if (limits_active() != ACTUATE_SETSPEED) {
+			/* the kernel keeps governing, we only move its floor */
+			if (strncmp(fbuf, "userspace", 9) == 0
+					&& (err = hand_back(pol)) != 0) {
+				errno = err;
+				perror("Can't find a kernel governor, exiting");
+				return err;
+			}
+		} else if (strncmp(fbuf, "userspace", 9) != 0) {
+			if ((err = write_file(scratch, "userspace\n")) != 0) {
+				errno = err;
+				perror("Error writing file governor");
+				return err;
+			}
+			if ((err = read_file_to(scratch, 0, 1, fbuf, sizeof(fbuf))) != 0) {
+				errno = err;
+				perror("Error reading back governor file");
+				return err;
+			}
+			if (strncmp(fbuf, "userspace", 9) != 0) {
+				perror("Can't set to userspace governor, exiting");
+				return EPIPE;
+			}
+		}
+	}
+	
+	/*
+	 * Some cpufreq drivers (longhaul) report speeds in MHz instead
+	 * of KHz.  Assume for now that any currently supported cpufreq 
+	 * processor will a) not be faster then 10GHz, and b) not be slower
+	 * then 10MHz. Therefore, is the number for max_speed is less than
+	 * 10000, assume the driver is reporting speeds in MHz, not KHz,
+	 * and adjust accordingly.
+	 *
+	 * XXXjc the longhaul driver has been fixed (2.6.5ish timeframe)
+	 * so this should't be needed anymore.  Remove for 1.0?
+	 */
+	pol->in_mhz = 0;
+	if (pol->max_speed <= 10000) {
+		pol->in_mhz = 1;
+		pol->max_speed *= 1000;
+		pol->min_speed *= 1000;
+		pol->current_speed *= 1000;
+	}
+	pol->cpuinfo_max = pol->max_speed;
+	pol->cpuinfo_min = pol->min_speed;
+	if (shadow)
+		return shadow_start(pol);
+	return 0;
+}
+
+/**
+ * Allocates and initialises the per-cpu data structures.
+ */
+int get_per_cpu_info(cpuinfo_t *cpu, int cpuid) {
+	int err;
+
+	cpu->cpuid = cpuid;
+	cpu->last_reading = (cpustats_t *)malloc(sizeof(cpustats_t));
+	cpu->reading = (cpustats_t *)malloc(sizeof(cpustats_t));
+	if (cpu->last_reading == NULL || cpu->reading == NULL) {
+		perror("Couldn't allocate per-cpu readings");
+		return ENOMEM;
+	}
+	memset(cpu->last_reading, 0, sizeof(cpustats_t));
+	memset(cpu->reading, 0, sizeof(cpustats_t));
+	
+	if (use_cpu_load) {
+		if ((cpu->fd = open("/proc/stat", O_RDONLY)) < 0) {
+			err = errno;
+			perror("can't open /proc/stat");
+			return err;
+		}
+		
+		/* offline cpus are missing there */
+		if (cpu->policy && (err = get_stat(cpu)) < 0) {
+			perror("can't read /proc/stat");
+			return err;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Parse a cpu list like "0-3,8 10" into cpus[]. Returns the number of
+ * cpus found below max_cpus.
+ */
+int parse_cpu_list(const char *str, int *cpus, int max_cpus) {
+	char *p = (char *)str;
+	long first, last, i;
+	int n = 0;
+
+	while (*p) {
+		if (*p < '0' || *p > '9') {
+			p++;
+			continue;
+		}
+		first = last = strtol(p, &p, 10);
+		if (*p == '-')
+			last = strtol(p + 1, &p, 10);
+		for (i = first; i <= last && i < max_cpus; i++)
+			cpus[n++] = i;
+	}
+	return n;
+}
+
+/* cpu0 often can't go offline and has no online file */
+int cpu_online(int cpuid) {
+	char path[100], str[8];
+
+	snprintf(path, sizeof(path), SYSFS_TREE "cpu%d/online", cpuid);
+	if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+		return 1;
+	return str[0] == '1';
+}
+
+static int policy_grouping = 0; /* threads per core from -c, 0 - the kernel's */
+
+/* the cpus sharing the speed of a cpu, it may or may not be among them */
+int policy_members(int cpuid, int *members, int ncpus) {
+	char path[100], fbuf[1024];
+	int j, n = 0;
+
+	if (policy_grouping) {
+		for (j = cpuid - cpuid % policy_grouping;
+				j < cpuid - cpuid % policy_grouping + policy_grouping && j < ncpus; j++)
+			members[n++] = j;
+	} else {
+		snprintf(path, sizeof(path),
+				SYSFS_TREE "cpu%d/cpufreq/affected_cpus", cpuid);
+		if (read_file_to(path, 0, 1, fbuf, sizeof(fbuf)) == 0)
+			n = parse_cpu_list(fbuf, members, ncpus);
+	}
+	return n;
+}
+
+/**
+ * Create the policy of an online cpu that has none yet, claiming its
+ * online siblings that have none either, and append it to policies.
+ * @return the policy or NULL
+ */
+policy_t *new_policy(int cpuid, int ncpus) {
+	int *members, j, n;
+	policy_t *pol;
+
+	if ((members = (int *)malloc(ncpus * sizeof(int))) == NULL) {
+		perror("Couldn't malloc policy");
+		return NULL;
+	}
+	n = policy_members(cpuid, members, ncpus);
+
+	pol = (policy_t *)calloc(1, sizeof(policy_t));
+	if (pol == NULL || (pol->cpus = (int *)malloc((n + 1) * sizeof(int))) == NULL) {
+		perror("Couldn't malloc policy");
+		free(pol);
+		free(members);
+		return NULL;
+	}
+	pol->id = cpuid;
+	pol->irq_floor_index = -1;
+	/* the cpu we started from always belongs to its policy */
+	all_cpus[cpuid]->policy = pol;
+	pol->cpus[pol->ncpus++] = cpuid;
+	for (j = 0; j < n; j++) {
+		if (all_cpus[members[j]]->policy || !cpu_online(members[j]))
+			continue;
+		all_cpus[members[j]]->policy = pol;
+		pol->cpus[pol->ncpus++] = members[j];
+	}
+	free(members);
+	policies[npolicies++] = pol;
+	return pol;
+}
+
+/**
+ * Group the online cpus into policies. Without -c one affected_cpus read
+ * per policy is enough: all the cpus listed there are claimed at once.
+ * @param threads_per_core >0 - static grouping from -c
+ */
+int build_policies(int ncpus, int threads_per_core) {
+	int i;
+
+	policies = (policy_t **)calloc(ncpus, sizeof(policy_t *));
+	if (policies == NULL) {
+		perror("Couldn't malloc policies");
+		return ENOMEM;
+	}
+	npolicies = 0;
+	policy_grouping = threads_per_core;
+
+	for (i = 0; i < ncpus; i++) {
+		if (all_cpus[i]->policy || !cpu_online(i))
+			continue;
+		if (new_policy(i, ncpus) == NULL)
+			return ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * Initialise all policies with a pool of threads taking the next
+ * uninitialised policy until none is left.
+ */
+#define MAX_INIT_THREADS 16
+
+static int next_policy = 0;
+static int init_error = 0;
+
+void *init_policies_thread(void *arg) {
+	int i, err;
+
+	while ((i = __atomic_fetch_add(&next_policy, 1, __ATOMIC_RELAXED)) < npolicies) {
+		if ((err = get_policy_info(policies[i])) != 0)
+			__atomic_store_n(&init_error, err, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+int init_policies(void) {
+	pthread_t threads[MAX_INIT_THREADS];
+	int nthreads, i, started = 0;
+
+	nthreads = npolicies < MAX_INIT_THREADS ? npolicies : MAX_INIT_THREADS;
+	for (i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[started], NULL, init_policies_thread, NULL))
+			break;
+		started++;
+	}
+	/* the main thread helps */
+	init_policies_thread(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pprintf(4, "initialised %d policies with %d threads\n", npolicies, started + 1);
+	return init_error;
+}
+
+void free_policy(policy_t *pol) {
+	shadow_stop(pol);
+	if (pol->wfd) close(pol->wfd);
+	if (pol->cur_fd > 0) close(pol->cur_fd);
+	free(pol->freq_hits);
+	free(pol->freq_misses);
+	free(pol->model_residual);
+	free(pol->sysfs_dir);
+	free(pol->freq_table);
+	free(pol->cpus);
+	free(pol);
+}
+
+/********************************************************************/
+
+/*
+ * The heart of the program... decide to raise or lower the speed.
+ */
+enum modes decide_speed(cpuinfo_t *cpu, float dspload) {
+	policy_t *pol = cpu->policy;
+	const governor_params_t gp = {
+		.highwater_dsp = highwater_dsp,
+		.lowwater_dsp = lowwater_dsp,
+		.use_cpu_load = use_cpu_load,
+		.highwater_cpu = highwater_cpu,
+		.lowwater_cpu = lowwater_cpu
+	};
+	int dsp_raise, dsp_lower, at_max, at_min;
+	float pct = 0;
+
+	pprintf(4, "decide_speed: dspload=%f, lowwater_dsp=%d, highwater_dsp=%d, pol->current_pstate_mode=%d\n", dspload, lowwater_dsp, highwater_dsp, pol->current_pstate_mode);
+
+	if (model_ready(pol) || pol->sens_limited) {
+		dsp_raise = pol->target_index < pol->speed_index;
+		dsp_lower = pol->target_index > pol->speed_index;
+	} else {
+		governor_dsp_limits(&gp, dspload, &dsp_raise, &dsp_lower);
+	}
+
+	if (use_cpu_load && (pct = cgroup_load_active()
+				? cgroup_cpu_load(cpu->cpuid) : calc_stat(cpu)) < 0) {
+		return SAME; // error
+	}
+
+	if (pol->is_pstate) {
+		at_max = pol->current_pstate_mode == RAISE;
+		at_min = pol->current_pstate_mode == LOWER;
+	} else {
+		at_max = pol->current_speed == pol->max_speed;
+		at_min = pol->current_speed == pol->min_speed;
+	}
+
+	if (use_cpu_load && governor_cpu_bound(&gp, pct))
+		psi_cpu_bound(monotonic_ns());
+	/* the CPU load overrides the model */
+	if (governor_cpu_bound(&gp, pct) && !at_max)
+		pol->target_index = 0;
+
+	return governor_decide(&gp, dsp_raise, dsp_lower, pct, at_max, at_min);
+}
+
+/********************************************************************/
+
+/*
+ * Preemptive boost: graph reorders, new clients and buffer size changes
+ * announce more DSP work before the load shows it. Raise the policies of
+ * the JACK cpus for boost_window msecs and drop back to where they were
+ * if the load did not follow.
+ */
+#define EDIT_WINDOW_DEFAULT 2000 /* msecs, to count xruns without boosting */
+
+static long long boost_until_ns = 0;
+static long long edit_until_ns = 0;
+static float boost_start_load = 0;
+
+int policy_runs_jack(policy_t *pol, const cpu_set_t *jack_cpus) {
+	int j;
+
+	if (jack_cpus == NULL)
+		return 1;
+	for (j = 0; j < pol->ncpus; j++)
+		if (CPU_ISSET(pol->cpus[j], jack_cpus))
+			return 1;
+	return 0;
+}
+
+void boost_policy(policy_t *pol) {
+	if (pol->boosted || pol->transition_locked)
+		return;
+
+	pol->boosted = 1;
+	pol->boost_saved_index = pol->speed_index;
+	pol->boost_saved_mode = pol->current_pstate_mode;
+	if (pol->is_pstate) {
+		if (pol->current_pstate_mode != RAISE)
+			set_pstate_mode(pol, RAISE);
+	} else if (pol->speed_index != 0) {
+		pol->speed_index = 0;
+		set_speed(pol);
+	}
+}
+
+void unboost_policy(policy_t *pol, float dspload) {
+	pol->boosted = 0;
+
+	/* more load at a higher speed: the work did grow, keep it */
+	if (dspload > boost_start_load) {
+		boost_kept++;
+		return;
+	}
+	pprintf(3, "policy %d: load did not follow the boost, dropping back\n",
+			pol->id);
+	if (pol->is_pstate) {
+		set_pstate_mode(pol, pol->boost_saved_mode);
+	} else {
+		if (pol->boost_saved_index >= pol->table_size)
+			pol->boost_saved_index = pol->table_size - 1;
+		if (pol->speed_index == pol->boost_saved_index)
+			return;
+		pol->speed_index = pol->boost_saved_index;
+		set_speed(pol);
+	}
+}
+
+void session_edit(int jack_pid, float dspload, long long now) {
+	cpu_set_t jack_cpus;
+	int have_set, i;
+
+	edit_count++;
+	edit_until_ns = now + (boost_window ? boost_window
+			: EDIT_WINDOW_DEFAULT) * 1000000LL;
+	if (!boost_window)
+		return;
+
+	pprintf(2, "Session edit, raising the JACK cpus for %u msecs\n",
+			boost_window);
+	CPU_ZERO(&jack_cpus);
+	have_set = jack_pid
+		&& sched_getaffinity(jack_pid, sizeof(jack_cpus), &jack_cpus) == 0;
+	if (now >= boost_until_ns) {
+		boost_start_load = dspload;
+		boost_count++;
+	}
+	boost_until_ns = edit_until_ns;
+	for (i = 0; i < npolicies; i++)
+		if (policy_runs_jack(policies[i], have_set ? &jack_cpus : NULL))
+			boost_policy(policies[i]);
+}
+
+/*
+ * A transition-unsafe policy goes to its highest speed once and stays
+ * there until the session ends: no more transitions to glitch on.
+ */
+void lock_policy(policy_t *pol) {
+	pprintf(1, "policy %d: locking the speed for this session\n", pol->id);
+	pol->transition_locked = 1;
+	pol->boosted = 0;
+	if (pol->is_pstate) {
+		if (pol->current_pstate_mode != RAISE)
+			set_pstate_mode(pol, RAISE);
+	} else if (pol->speed_index != 0) {
+		pol->speed_index = 0;
+		set_speed(pol);
+	}
+}
+
+void unlock_policies(void) {
+	int i;
+
+	for (i = 0; i < npolicies; i++)
+		policies[i]->transition_locked = 0;
+	glitch_new_session();
+}
+
+/********************************************************************/
+
+/*
+ * Audio interrupt floor: a cpu handling the sound card interrupts that
+ * runs slowly delays the period wakeup of the whole graph, however small
+ * its own load. Hold the policies of the cpus that saw audio interrupts
+ * in the last tick at irq_floor_pct of their max speed or above.
+ */
+static double irq_rate_max = 0;
+static unsigned int irq_floor_raises = 0;
+
+void update_irq_floors(double seconds) {
+	cpu_set_t cpus;
+	double rate;
+	int i, j, k;
+
+	if (!irq_floor_pct)
+		return;
+
+	rate = audio_irq_update(&cpus, seconds);
+	if (rate > irq_rate_max)
+		irq_rate_max = rate;
+	pprintf(4, "audio interrupts: %.0f per second on %d cpus\n",
+			rate, CPU_COUNT(&cpus));
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		pol->irq_floor_index = -1;
+		if (pol->is_pstate)
+			continue;
+		for (j = 0; j < pol->ncpus; j++)
+			if (CPU_ISSET(pol->cpus[j], &cpus))
+				break;
+		if (j == pol->ncpus)
+			continue;
+		/* the slowest entry still at the floor, the table is descending */
+		for (k = pol->table_size - 1; k > 0; k--)
+			if (pol->freq_table[k] * 100 >= pol->freq_table[0] * irq_floor_pct)
+				break;
+		pol->irq_floor_index = k;
+	}
+}
+
+/**
+ * Keep the policy's decision above its audio interrupt floor.
+ * @return 1 if the policy runs below the floor and has to be raised to it
+ */
+int irq_floor(policy_t *pol, enum modes *change) {
+	unsigned int floor = pol->irq_floor_index;
+
+	if (pol->irq_floor_index < 0)
+		return 0;
+	if (pol->target_index > pol->irq_floor_index)
+		pol->target_index = pol->irq_floor_index;
+	if (*change == LOWER && pol->speed_index >= floor)
+		*change = SAME;
+	if (*change == SAME && pol->speed_index > floor) {
+		irq_floor_raises++;
+		return 1;
+	}
+	return 0;
+}
+
+/********************************************************************/
+
+/*
+ * Idle sessions: jackd runs, but the transport is stopped, no client
+ * ports are connected and the DSP load stays near zero. Then stop
+ * governing until the transport starts or something gets connected.
+ */
+#define IDLE_MAX_LOAD 2.0 /* DSP load percent */
+
+static int session_is_idle = 0;
+static long long idle_since_ns = 0;
+
+int session_idle(float dspload, long long now) {
+	if (idle_posture == IDLE_OFF || jjack_transport_rolling()
+			|| jjack_connections() > 0 || dspload >= IDLE_MAX_LOAD) {
+		idle_since_ns = 0;
+		return 0;
+	}
+	if (!idle_since_ns)
+		idle_since_ns = now;
+	return now - idle_since_ns >= idle_after * 1000000000LL;
+}
+
+void enter_idle(void) {
+	int i;
+
+	pprintf(1, "Session idle, %s\n", idle_posture == IDLE_KERNEL
+			? "handing the cpus back to the kernel" : "holding the lowest speed");
+	session_is_idle = 1;
+	idle_count++;
+	cpuidle_release();
+	turbo_idle(monotonic_ns());
+	uncore_release();
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		pol->boosted = 0;
+		if (pol->is_pstate) {
+			set_pstate_mode(pol, LOWER);
+		} else if (idle_posture == IDLE_KERNEL
+				&& limits_active() != ACTUATE_SETSPEED) {
+			limits_restore(pol);
+		} else if (idle_posture != IDLE_KERNEL || hand_back(pol) != 0) {
+			pol->speed_index = pol->table_size - 1;
+			set_speed(pol);
+		}
+	}
+	jjack_watch_transport(1);
+}
+
+void leave_idle(int reasons) {
+	int i;
+
+	pprintf(1, "Session active again (wake reasons %#x)\n", reasons);
+	session_is_idle = 0;
+	idle_since_ns = 0;
+	jjack_watch_transport(0);
+	/* whatever starts now, start it fast */
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->is_pstate) {
+			set_pstate_mode(pol, RAISE);
+			continue;
 		}
+		if (idle_posture == IDLE_KERNEL && limits_active() == ACTUATE_SETSPEED)
+			set_governor(pol, "userspace");
+		pol->speed_index = 0;
+		set_speed(pol);
 	}
+}
 
-	/* now lets sort the table just to be sure */
-	qsort(cpu->freq_table, cpu->table_size, sizeof(unsigned long), 
-			&faked_compare);
-	
-	cpu->is_pstate = 0;
-	strncpy(scratch, cpu->sysfs_dir, 50);
-	strncat(scratch, "scaling_driver", 20);
+/* --actuator compare: hand the policies over between the two epochs */
+void switch_actuator(void) {
+	int i;
 
-	if ((err = read_file(scratch, 0, 1)) == 0) {
-	  if (strncmp(buf, "intel_pstate", 12) == 0) {
-	    cpu->is_pstate = 1;
-	    cpu->current_pstate_mode = SAME;
-	  }
+	pprintf(2, "Switching to %s\n", limits_active() == ACTUATE_SETSPEED
+			? "scaling_setspeed" : "the kernel governor above a floor");
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->is_pstate)
+			continue;
+		if (limits_active() == ACTUATE_SETSPEED) {
+			set_governor(pol, "userspace");
+			limits_restore(pol);
+			set_speed(pol);
+		} else {
+			set_speed(pol);
+			hand_back(pol);
+		}
 	}
+}
 
-	if (! cpu->is_pstate) {
-		strncpy(scratch, cpu->sysfs_dir, 50);
-		strncat(scratch, "scaling_governor", 20);
+/********************************************************************/
 
-		if ((err = read_file(scratch, 0, 1)) != 0) {
-			perror("couldn't open scaling_governors file");
-			return err;
-		}
+/*
+ * CPU hotplug: only the policies of the cpus coming or going are rebuilt.
+ * All other policies keep being governed and JACK stays connected.
+ */
+void detach_policy(policy_t *pol) {
+	int i, j;
 
-		if (strncmp(buf, "userspace", 9) != 0) {
-			if ((fd = open(scratch, O_RDWR)) < 0) {
-				err = errno;
-				perror("couldn't open govn's file for writing");
-				return err;
-			}
-			strncpy(tmp, "userspace\n", 11);
-			if (write(fd, tmp, 11*sizeof(char)) < 0) {
-				err = errno;
-				perror("Error writing file governor");
-				close(fd);
-				return err;
-			}
-			if ((err = read_file(scratch, fd, 0)) != 0) {
-				perror("Error reading back governor file");
-				close(fd);
-				return err;
-			}
-			close(fd);
-			if (strncmp(buf, "userspace", 9) != 0) {
-				perror("Can't set to userspace governor, exiting");
-				return EPIPE;
-			}
+	for (j = 0; j < pol->ncpus; j++)
+		all_cpus[pol->cpus[j]]->policy = NULL;
+	for (i = 0; i < npolicies; i++) {
+		if (policies[i] != pol)
+			continue;
+		memmove(&policies[i], &policies[i + 1],
+				(npolicies - i - 1) * sizeof(policy_t *));
+		npolicies--;
+		break;
+	}
+}
+
+/* what was learned about the speeds holds as long as they are the same */
+void inherit_policy(policy_t *pol, const policy_t *old) {
+	if (old->table_size != pol->table_size
+			|| memcmp(old->freq_table, pol->freq_table,
+				pol->table_size * sizeof(unsigned long)) != 0)
+		return;
+	memcpy(pol->freq_hits, old->freq_hits, pol->table_size);
+	memcpy(pol->model_residual, old->model_residual,
+			pol->table_size * sizeof(float));
+	pol->model_work = old->model_work;
+	pol->model_samples = old->model_samples;
+	pol->transitions = old->transitions;
+	pol->glitchy_transitions = old->glitchy_transitions;
+	pol->transition_unsafe = old->transition_unsafe;
+	pol->session_glitchy = old->session_glitchy;
+}
+
+/* a new policy starts fast, or in the idle posture */
+void start_policy(policy_t *pol) {
+	int j;
+
+	if (session_is_idle && pol->is_pstate) {
+		set_pstate_mode(pol, LOWER);
+	} else if (session_is_idle && idle_posture == IDLE_KERNEL
+			&& limits_active() != ACTUATE_SETSPEED) {
+		/* the saved limits are in place already */
+	} else if (session_is_idle) {
+		if (idle_posture != IDLE_KERNEL || hand_back(pol) != 0) {
+			pol->speed_index = pol->table_size - 1;
+			set_speed(pol);
 		}
+	} else if (pol->is_pstate) {
+		set_pstate_mode(pol, RAISE);
+	} else {
+		change_speed(pol, RAISE);
 	}
-	
-	cpu->last_reading = (cpustats_t *)malloc(sizeof(cpustats_t));
-	cpu->reading = (cpustats_t *)malloc(sizeof(cpustats_t));
-	memset(cpu->last_reading, 0, sizeof(cpustats_t));
-	memset(cpu->reading, 0, sizeof(cpustats_t));
-	
-	/*
-	 * Some cpufreq drivers (longhaul) report speeds in MHz instead
-	 * of KHz.  Assume for now that any currently supported cpufreq 
-	 * processor will a) not be faster then 10GHz, and b) not be slower
-	 * then 10MHz. Therefore, is the number for max_speed is less than
-	 * 10000, assume the driver is reporting speeds in MHz, not KHz,
-	 * and adjust accordingly.
-	 *
-	 * XXXjc the longhaul driver has been fixed (2.6.5ish timeframe)
-	 * so this should't be needed anymore.  Remove for 1.0?
-	 */
-	cpu->in_mhz = 0;
-	if (cpu->max_speed <= 10000) {
-		cpu->in_mhz = 1;
-		cpu->max_speed *= 1000;
-		cpu->min_speed *= 1000;
-		cpu->current_speed *= 1000;
+	/* the first load reading needs a previous one */
+	if (use_cpu_load)
+		for (j = 0; j < pol->ncpus; j++)
+			get_stat(all_cpus[pol->cpus[j]]);
+}
+
+/**
+ * Rebuild the policies around a cpu whose online state changed: its own
+ * one and those of its siblings are dropped and built again from the
+ * cpus online now.
+ */
+void rebuild_cpu(int cpuid, int ncpus) {
+	policy_t **old;
+	int *members, *cpus, nold = 0, ncpu = 0, n, i, j, k;
+
+	old = (policy_t **)malloc(ncpus * sizeof(policy_t *));
+	members = (int *)malloc(ncpus * sizeof(int));
+	cpus = (int *)calloc(ncpus, sizeof(int));
+	if (old == NULL || members == NULL || cpus == NULL) {
+		perror("Couldn't malloc policy");
+		goto out;
 	}
-	
-	if (use_cpu_load) {
-		if ((cpu->fd = open("/proc/stat", O_RDONLY)) < 0) {
-			err = errno;
-			perror("can't open /proc/stat");
-			return err;
-		}
-		
-		if ((err = get_stat(cpu)) < 0) {
-			perror("can't read /proc/stat");
-			return err;
+
+	n = policy_members(cpuid, members, ncpus);
+	members[n++] = cpuid;
+	for (i = 0; i < n; i++) {
+		policy_t *pol = all_cpus[members[i]]->policy;
+
+		cpus[members[i]] = 1;
+		if (pol == NULL)
+			continue;
+		for (j = 0; j < nold && old[j] != pol; j++)
+			;
+		if (j < nold)
+			continue;
+		old[nold++] = pol;
+		for (j = 0; j < pol->ncpus; j++)
+			cpus[pol->cpus[j]] = 1;
+		detach_policy(pol);
+	}
+
+	for (i = 0; i < ncpus; i++) {
+		policy_t *pol;
+
+		if (!cpus[i] || all_cpus[i]->policy || !cpu_online(i))
+			continue;
+		if ((pol = new_policy(i, ncpus)) == NULL)
+			break;
+		if (get_policy_info(pol) != 0) {
+			pprintf(1, "Can't govern policy%d, leaving it to the kernel\n",
+					pol->id);
+			detach_policy(pol);
+			free_policy(pol);
+			continue;
 		}
+		for (j = 0; j < nold; j++)
+			for (k = 0; k < old[j]->ncpus; k++)
+				if (old[j]->cpus[k] == (int)pol->id)
+					inherit_policy(pol, old[j]);
+		start_policy(pol);
+		ncpu += pol->ncpus;
+		pprintf(1, "  policy%d (%d CPU%s): %dMhz - %dMhz (%d steps)\n",
+				pol->id, pol->ncpus, (pol->ncpus > 1) ? "s" : "",
+				pol->min_speed / 1000, pol->max_speed / 1000,
+				pol->table_size);
 	}
-	return 0;
+	pprintf(1, "cpu%d went %s, rebuilt %d polic%s for %d CPU%s\n", cpuid,
+			cpu_online(cpuid) ? "online" : "offline", nold,
+			nold == 1 ? "y" : "ies", ncpu, ncpu == 1 ? "" : "s");
+
+	for (j = 0; j < nold; j++)
+		free_policy(old[j]);
+out:
+	free(old);
+	free(members);
+	free(cpus);
+}
+
+/* only the cpus whose online state really differs from ours are rebuilt */
+void handle_hotplug(int ncpus) {
+	int cpu;
+
+	while ((cpu = hotplug_next()) >= 0)
+		if (cpu_online(cpu) != (all_cpus[cpu]->policy != NULL))
+			rebuild_cpu(cpu, ncpus);
 }
 
 /********************************************************************/
 
 /*
- * The heart of the program... decide to raise or lower the speed.
+ * Load sources: the JACK client, or the status of the running ALSA PCM
+ * streams in procfs, which needs no client and no privilege switching.
+ * With --load-source both, ALSA alone keeps the daemon going while there
+ * is no JACK server.
  */
-enum modes decide_speed(cpuinfo_t *cpu, float dspload) {
-	pprintf(4, "decide_speed: dspload=%f, lowwater_dsp=%d, highwater_dsp=%d, cpu->current_pstate_mode=%d\n", dspload, lowwater_dsp, highwater_dsp, cpu->current_pstate_mode);
+unsigned int period_usecs(void) {
+	return jjack_is_open() ? jjack_period_usecs() : alsa_period_usecs();
+}
 
-	if (use_cpu_load) {
-		float pct;
-		if ((pct = calc_stat(cpu)) < 0) {
-			return SAME; // error
-		}
-		if (((dspload > highwater_dsp) || (pct >= ((float)highwater_cpu/100.0))) 
-				&& (cpu->current_speed != cpu->max_speed)) {
-			return RAISE;
-		}
-		else if (((dspload < lowwater_dsp) && (pct <= ((float)lowwater_cpu/100.0))) 
-		         && (cpu->current_speed != cpu->min_speed)) {
-			return LOWER;
+unsigned int total_xruns(void) {
+	return jjack_xruns() + alsa_xruns();
+}
+
+/* the process whose cpus carry the DSP load, 0 - unknown */
+int load_pid(const ProcessInfo *jack_server_process) {
+	return jjack_is_open() ? jack_server_process->pid : alsa_owner_pid();
+}
+
+/* the sound card interrupts may have changed with a new server or stream */
+void rescan_audio_irqs(void) {
+	if (irq_floor_pct && !audio_irq_scan())
+		pprintf(1, "No audio interrupts found\n");
+}
+
+/**
+ * Connect to the JACK server, looking it up first if needed.
+ * @return 0, ESRCH if there is no server or ECONNREFUSED
+ */
+int connect_jack(ProcessInfo *jack_server_process, int filter_uid, int filter_gid) {
+	if (!jack_server_process->pid) {
+		get_jack_proc(filter_uid, filter_gid, jack_server_process);
+		if (!jack_server_process->pid)
+			return ESRCH;
+	}
+	if (jjack_open(jack_server_process))
+		return ECONNREFUSED;
+	rt_below_jack(jjack_rt_priority());
+	rescan_audio_irqs();
+	perfsens_open(jack_server_process->pid);
+	psi_watch_pid(jack_server_process->pid);
+	cgroup_load_open(jack_server_process->pid);
+	return 0;
+}
+
+float poll_alsa(void) {
+	if (!alsa_is_open() && alsa_open()) {
+		rescan_audio_irqs();
+		if (!jjack_is_open()) {
+			perfsens_open(alsa_owner_pid());
+			psi_watch_pid(alsa_owner_pid());
+			cgroup_load_open(alsa_owner_pid());
 		}
-		return SAME;
 	}
+	return alsa_poll();
+}
+
+/********************************************************************/
+
+/*
+ * Adaptive poll interval: a few JACK periods while the load approaches
+ * the upper limit or rises, doubling up to poll_max while every policy
+ * sits at its lowest speed with a flat load, poll otherwise.
+ */
+#define ADAPTIVE_NEAR_PCT 80   /* of highwater_dsp */
+#define ADAPTIVE_RISE 2.0      /* DSP load percent per poll */
+#define ADAPTIVE_FLAT 1.0
+#define ADAPTIVE_FAST_PERIODS 4
+#define ADAPTIVE_FAST_MIN 5    /* msecs */
+
+int all_policies_at_max(void) {
+	int i;
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->is_pstate ? pol->current_pstate_mode != RAISE
+				: pol->current_speed != pol->max_speed)
+			return 0;
+	}
+	return 1;
+}
+
+int all_policies_at_min(void) {
+	int i;
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->is_pstate ? pol->current_pstate_mode != LOWER
+				: pol->current_speed != pol->min_speed)
+			return 0;
+	}
+	return 1;
+}
+
+unsigned int next_poll_interval(unsigned int last, float load, float prev_load) {
+	unsigned int fast;
+
+	if (!adaptive_poll)
+		return poll;
+
+	fast = poll_min;
+	if (!fast)
+		fast = ADAPTIVE_FAST_PERIODS * period_usecs() / 1000;
+	if (fast < ADAPTIVE_FAST_MIN)
+		fast = ADAPTIVE_FAST_MIN;
+	if (fast > poll)
+		fast = poll;
+
+	if (load * 100 >= highwater_dsp * ADAPTIVE_NEAR_PCT
+			|| load - prev_load >= ADAPTIVE_RISE)
+		return fast;
+
+	if (load < lowwater_dsp && load - prev_load < ADAPTIVE_FLAT
+			&& prev_load - load < ADAPTIVE_FLAT && all_policies_at_min()) {
+		if (last < poll)
+			last = poll;
+		return (last * 2 < poll_max) ? last * 2 : poll_max;
+	}
+	return poll;
+}
 
-	if (dspload > highwater_dsp && (cpu->is_pstate ? cpu->current_pstate_mode < RAISE : cpu->current_speed != cpu->max_speed)) {
-		return RAISE;
+/*
+ * Publish the state after a tick. Readers copy the page between two
+ * reads of seq, so this only costs the stores.
+ */
+void publish_status(int reasons, float load, unsigned int interval, long long now) {
+	jfd_status_t *st;
+	int i;
+
+	if ((st = status_begin()) == NULL)
+		return;
+
+	st->update_ns = now;
+	st->ticks++;
+	st->dsp_load = load;
+	st->jack_connected = jjack_is_open();
+	st->period_usecs = period_usecs();
+	st->wake_reasons = reasons;
+	st->poll_ms = interval;
+	st->speed_changes = change_speed_count;
+	st->xruns = total_xruns();
+	st->wakeups = wakeup_count;
+	st->drifts = drift_count;
+	st->pruned = pruned_count;
+	st->log_dropped = log_dropped();
+	st->npolicies = npolicies < JFD_STATUS_MAX_POLICIES
+		? npolicies : JFD_STATUS_MAX_POLICIES;
+	for (i = 0; i < st->npolicies; i++) {
+		policy_t *pol = policies[i];
+		jfd_status_policy_t *sp = &st->policies[i];
+
+		sp->id = pol->id;
+		sp->ncpus = pol->ncpus;
+		sp->cur_khz = pol->current_speed;
+		sp->min_khz = pol->min_speed;
+		sp->max_khz = pol->max_speed;
+		sp->mode = pol->current_pstate_mode;
+		sp->flags = (pol->is_pstate ? JFD_POLICY_PSTATE : 0)
+			| (pol->boosted ? JFD_POLICY_BOOSTED : 0)
+			| (pol->transition_unsafe ? JFD_POLICY_UNSAFE : 0)
+			| (pol->transition_locked ? JFD_POLICY_LOCKED : 0);
+		sp->transitions = pol->transitions;
+		sp->last_change_ns = pol->last_change_ns;
 	}
-	else if (dspload < lowwater_dsp && (cpu->is_pstate ? cpu->current_pstate_mode > LOWER : cpu->current_speed != cpu->min_speed)) {
-		return LOWER;
+	status_end();
+}
+
+/* xruns often come in bursts, one dump covers them */
+#define FLIGHTREC_DUMP_INTERVAL (10 * 1000000000LL)
+
+/*
+ * SIGUSR2 asks the main loop for a flight recorder dump. It stays blocked
+ * in all threads but this one, which takes it with sigwait(): waking the
+ * main loop takes the condvar, which no signal handler may touch.
+ */
+static volatile sig_atomic_t dump_requested = 0;
+static pthread_t dump_thread;
+
+void *wait_dump_requests(void *arg) {
+	sigset_t all, usr2;
+	int sig;
+
+	/* the other signals are for the main loop */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+	sigemptyset(&usr2);
+	sigaddset(&usr2, SIGUSR2);
+	while (sigwait(&usr2, &sig) == 0) {
+		dump_requested = 1;
+		trigger_wakeup(WAKE_SIGNAL);
 	}
-	return SAME;
+	return NULL;
+}
+
+/* block SIGUSR2 before any thread inheriting the mask gets created */
+int start_dump_requests(void) {
+	sigset_t usr2;
+	int err;
+
+	sigemptyset(&usr2);
+	sigaddset(&usr2, SIGUSR2);
+	if ((err = pthread_sigmask(SIG_BLOCK, &usr2, NULL)) != 0)
+		return err;
+	if ((err = pthread_create(&dump_thread, NULL, wait_dump_requests, NULL)) != 0)
+		return err;
+	return pthread_detach(dump_thread);
 }
 
 /********************************************************************/
@@ -627,40 +2066,58 @@ void terminate(int signum) {
 	term=1;
 	run=0;
 
+	/* what follows must not get lost in the ring at exit */
+	log_stop();
+	psi_stop();
+	hotplug_stop();
+
 	int ncpus, i;
 	cpuinfo_t *cpu;
+	policy_t *pol;
 	
 	pprintf(4,"exiting: resetting CPU to full speed..\n");
 
+	/* back under our control for the reset below */
+	if (session_is_idle)
+		leave_idle(0);
+
 	ncpus = sysconf(_SC_NPROCESSORS_CONF);
 	if (ncpus < 1) ncpus = 1;
 	
 	/* 
-	 * for each cpu, force it back to full speed.
+	 * for each policy, force it back to full speed.
 	 * don't mix this with the below statement.
 	 * 
 	 * 5 minutes ago I convinced myself you couldn't 
 	 * mix these two, now I can't remember why.  
 	 */
-	for(i = 0; i < ncpus; i++) {
-	  cpu = all_cpus[i];
-	  if (cpu->is_pstate) {
-	    change_speed(cpu, LOWER);
+	for(i = 0; i < npolicies; i++) {
+	  pol = policies[i];
+	  if (pol->is_pstate) {
+	    change_speed(pol, LOWER);
+	  } else if (limits_active() != ACTUATE_SETSPEED) {
+	    limits_restore(pol);
 	  } else {
-	    change_speed(cpu, RAISE);
+	    change_speed(pol, RAISE);
 	  }
 	}
 
+	glitch_report(1);
+	shadow_report(1);
+	if ((i = state_save(ncpus)) != 0)
+		pprintf(1, "Can't save the learned state: %s\n", strerror(i));
+
 	pprintf(4,"exiting: cleaning up 1/2.\n");
 
+	for(i = 0; i < npolicies; i++)
+		free_policy(policies[i]);
+	free(policies);
+
 	for(i = 0; i < ncpus; i++) {
 		cpu = all_cpus[i];
-		if (cpu->wfd) close(cpu->wfd);
 		if (cpu->fd) close(cpu->fd);
 		free(cpu->last_reading);
 		free(cpu->reading);
-		free(cpu->sysfs_dir);
-		free(cpu->freq_table);
 		free(cpu);
 	}
 	pprintf(4,"exiting: cleaning up 2/2.\n");
@@ -668,11 +2125,50 @@ void terminate(int signum) {
 
 	pprintf(4,"exiting: closing JACK connection\n");
 	jjack_close();
+	alsa_close();
+	cpuidle_release();
+	turbo_release();
+	uncore_release();
+	perfsens_close();
 
 	time_t duration = time(NULL) - start_time;
 	pprintf(1,"Statistics:\n");
 	pprintf(1,"  %d speed changes in %d seconds\n",
 			change_speed_count, (unsigned int) duration);
+	pprintf(1,"  %d speed drifts resynchronized, %d frequencies removed\n",
+			drift_count, pruned_count);
+	pprintf(1,"  %d xruns, %d wakeups (%.2f per second)\n",
+			total_xruns(), wakeup_count,
+			duration ? (float)wakeup_count / duration : 0.0);
+	if (reaction_count)
+		pprintf(1,"  event reaction latency: %.2f ms average, %.2f ms max\n",
+				reaction_sum_ms / reaction_count, reaction_max_ms);
+	pprintf(1,"  %d session edits, %d xruns within %u msecs after them\n",
+			edit_count, edit_xruns,
+			boost_window ? boost_window : EDIT_WINDOW_DEFAULT);
+	if (boost_window)
+		pprintf(1,"  %d preemptive boosts, the load followed %d times\n",
+				boost_count, boost_kept);
+	if (idle_posture != IDLE_OFF) {
+		pprintf(1,"  session idle %d times\n", idle_count);
+		energy_report(1, "in idle sessions", &idle_acct);
+	}
+	if (log_dropped())
+		pprintf(1,"  %u log messages dropped\n", log_dropped());
+	if (irq_floor_pct) {
+		pprintf(1,"  audio interrupts: %.0f per second max, %u raises to the floor\n",
+				irq_rate_max, irq_floor_raises);
+		audio_irq_report(2);
+	}
+	rt_report(1);
+	cpuidle_report(1);
+	turbo_report(1);
+	uncore_report(1);
+	limits_report(1);
+	perfsens_report(1);
+	psi_report(1);
+	energy_close();
+	status_close();
 	pprintf(0,"JACKfreqd Daemon Exiting.\n");
 
 	closelog();
@@ -841,16 +2337,23 @@ int main (int argc, char **argv) {
         int filter_uid = 0;
         int filter_gid = 0;
 	ProcessInfo jack_server_process;
-	cpuinfo_t *cpu;
-	int ncpus, i, j, err, num_real_cpus, threads_per_core, cpubase;
-	struct timespec pollts;
+	policy_t *pol;
+	int ncpus, i, j, err, threads_per_core;
+	struct timespec pollts, init_start, init_end;
+	unsigned int interval, last_interval;
+	int reasons;
+	long long event_ns, deadline_ns, now_ns;
+	unsigned int xruns, last_xruns = 0;
+	long long last_dump_ns = 0, last_save_ns;
+	float prev_load = 0;
 	enum modes change, change2;
 
 	/* Parse command line args */
 	while(1) {
 		int c;
 
-		c = getopt(argc, argv, "dnvqPwc:u:U:s:l:L:j:J:h");
+		c = getopt_long(argc, argv, "dnvqPwc:p:u:U:s:l:L:j:J:h",
+				long_options, NULL);
 		if (c == -1)
 			break;
 
@@ -943,6 +2446,177 @@ int main (int argc, char **argv) {
 			case 'w':
 				jack_reconnect =1;
 				break;
+			case OPT_DSP_STAT:
+				dsp_stat = parse_keyword(optarg, dsp_stat_names);
+				if (dsp_stat < 0) {
+					printf("unknown DSP load statistic '%s'\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_CSTATE:
+				cstate_mode = parse_keyword(optarg, cstate_mode_names);
+				if (cstate_mode < 0) {
+					printf("unknown idle state control '%s'\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_NO_VERIFY:
+				verify_speed_enabled = 0;
+				break;
+			case OPT_MODEL:
+				use_model = 1;
+				break;
+			case OPT_MODEL_TARGET:
+				model_target = strtol(optarg, NULL, 10);
+				if (model_target > 100) {
+					printf("model target must be between 0 and 100\n");
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_ADAPTIVE:
+				adaptive_poll = 1;
+				break;
+			case OPT_POLL_MIN:
+				poll_min = strtol(optarg, NULL, 10);
+				break;
+			case OPT_POLL_MAX:
+				poll_max = strtol(optarg, NULL, 10);
+				break;
+			case OPT_RT:
+				if ((rt_mode = parse_keyword(optarg, rt_mode_names)) < 0) {
+					printf("Unknown realtime mode %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_RT_PRIORITY:
+				rt_priority = strtol(optarg, NULL, 10);
+				if (rt_priority < sched_get_priority_min(SCHED_FIFO)
+						|| rt_priority > sched_get_priority_max(SCHED_FIFO)) {
+					printf("rt-priority must be in [%d .. %d]\n",
+							sched_get_priority_min(SCHED_FIFO),
+							sched_get_priority_max(SCHED_FIFO));
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_BOOST_WINDOW:
+				boost_window = strtol(optarg, NULL, 10);
+				break;
+			case OPT_GLITCH_WINDOW:
+				glitch_window_ms = strtol(optarg, NULL, 10);
+				break;
+			case OPT_GLITCH_THRESHOLD:
+				glitch_threshold_pct = strtol(optarg, NULL, 10);
+				if (glitch_threshold_pct > 100) {
+					printf("glitch-threshold must be between 0 and 100");
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_NO_RECORDER:
+				flightrec_enabled = 0;
+				break;
+			case OPT_DECODE:
+				exit(flightrec_decode(optarg));
+			case OPT_SYNC_LOG:
+				async_log = 0;
+				break;
+			case OPT_NO_STATUS:
+				status_enabled = 0;
+				break;
+			case OPT_NO_STATE:
+				state_enabled = 0;
+				break;
+			case OPT_IDLE_POSTURE:
+				if ((idle_posture = parse_keyword(optarg, idle_posture_names)) < 0) {
+					printf("Unknown idle posture %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_IDLE_AFTER:
+				idle_after = strtol(optarg, NULL, 10);
+				break;
+			case OPT_IRQ_FLOOR:
+				irq_floor_pct = strtol(optarg, NULL, 10);
+				if (irq_floor_pct > 100) {
+					printf("interrupt floor must be between 0 and 100\n");
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_LOAD_SOURCE:
+				if ((load_source = parse_keyword(optarg, load_source_names)) < 0) {
+					printf("Unknown load source %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_PROCFS_ROOT:
+				procfs_root = optarg;
+				break;
+			case OPT_TURBO:
+				if ((turbo_mode = parse_keyword(optarg, turbo_mode_names)) < 0) {
+					printf("Unknown turbo mode %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_TURBO_DWELL:
+				turbo_dwell = strtol(optarg, NULL, 10);
+				break;
+			case OPT_PERF_SENSITIVITY:
+				perf_sens_pct = strtol(optarg, NULL, 10);
+				if (perf_sens_pct > 100) {
+					printf("sensitivity must be between 0 and 100\n");
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_PSI:
+				psi_stall_ms = strtol(optarg, NULL, 10);
+				if (psi_stall_ms >= PSI_WINDOW_MS) {
+					printf("pressure stall must be below %d msecs\n", PSI_WINDOW_MS);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_CGROUP:
+				cgroup_arg = optarg;
+				use_cpu_load = 1;
+				break;
+			case OPT_SHADOW:
+				shadow = 1;
+				break;
+			case OPT_POWER_MODEL:
+				power_model_file = optarg;
+				break;
+			case OPT_ACTUATOR:
+				if ((actuator = parse_keyword(optarg, actuator_names)) < 0) {
+					printf("Unknown actuator %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_UNCORE:
+				if ((uncore_mode = parse_keyword(optarg, uncore_mode_names)) < 0) {
+					printf("Unknown uncore mode %s\n", optarg);
+					help();
+					exit(ENOTSUP);
+				}
+				break;
+			case OPT_CSTATE_BUDGET:
+				cstate_budget_pct = strtol(optarg, NULL, 10);
+				if (cstate_budget_pct > 100) {
+					printf("idle state budget must be between 0 and 100\n");
+					help();
+					exit(ENOTSUP);
+				}
+				break;
 			case 'h':
 			default:
 				help();
@@ -968,8 +2642,10 @@ int main (int argc, char **argv) {
 		exit(ENOTSUP);
 	}
 
-	/* so we don't interfere with anything, including ourself */
-	nice(5);
+	if (!model_target)
+		model_target = (lowwater_dsp + highwater_dsp) / 2;
+	if (poll_max < poll)
+		poll_max = poll;
 
 	if (daemonize)
 		openlog("jackfreqd", LOG_AUTHPRIV|LOG_PERROR, LOG_DAEMON);
@@ -985,6 +2661,8 @@ int main (int argc, char **argv) {
 		ncpus = 1;
 	}
 	
+	clock_gettime(CLOCK_MONOTONIC, &init_start);
+
 	if (cores_specified) {
 		if (ncpus < cores_specified) {
 			printf("\nWARNING: bogus # of thread per core, assuming 1\n");
@@ -992,6 +2670,9 @@ int main (int argc, char **argv) {
 		} else {
 			threads_per_core = cores_specified;
 		}
+	} else if (access(SYSFS_TREE "cpu0/cpufreq/affected_cpus", R_OK) == 0) {
+		/* group by the policies the kernel reports */
+		threads_per_core = 0;
 	} else { 
 		threads_per_core = determine_threads_per_core(ncpus);
 		if (threads_per_core < 0) 
@@ -999,7 +2680,7 @@ int main (int argc, char **argv) {
 	}
 	
 	/* We don't support mixed configs yet */
-	if (!ncpus || !threads_per_core || ncpus % threads_per_core) {	
+	if (threads_per_core && (!ncpus || ncpus % threads_per_core)) {	
 		printf("WARN: ncpus(%d) is not a multiple of threads_per_core(%d)!\n",
 			ncpus, threads_per_core);
 		printf("WARN: Assuming 1.\n");
@@ -1007,8 +2688,6 @@ int main (int argc, char **argv) {
 		/*help(); exit(ENOTSUP); */
 	}
 	
-	num_real_cpus = ncpus/threads_per_core;
-
 	/* Malloc, initialise data structs */
 	all_cpus = (cpuinfo_t **) malloc(sizeof(cpuinfo_t *)*ncpus);
 	if (all_cpus == (cpuinfo_t **)NULL) {
@@ -1025,113 +2704,267 @@ int main (int argc, char **argv) {
 		memset(all_cpus[i],0,sizeof(cpuinfo_t));
 	}
 	
-	for (i=0;i<ncpus;i++) {
-		all_cpus[i]->threads_per_core = threads_per_core;
-		all_cpus[i]->scalable_unit = (i/threads_per_core)*threads_per_core;
+	if ((err = build_policies(ncpus, threads_per_core)) != 0
+			|| (err = init_policies()) != 0) {
+		printf("\n");
+		printf("JACKfreqd encountered and error and could not start.\n");
+		exit(err);
 	}
-	
-	pprintf(0,"Found %d scalable unit%s:  -- %d 'CPU%s' per scalable unit\n",
-			num_real_cpus,
-			(num_real_cpus>1)?"s":"",
-			threads_per_core,
-			(threads_per_core>1)?"s":"");
-	
+
 	for (i=0;i<ncpus;i++) {
-		cpu = all_cpus[i];
-		if ((err = get_per_cpu_info(cpu, i)) != 0) {
+		if ((err = get_per_cpu_info(all_cpus[i], i)) != 0) {
 			printf("\n");
 			printf("JACKfreqd encountered and error and could not start.\n");
-	    free(cpu);
 			exit(err);
 		}
-		pprintf(0,"  cpu%d: %dMhz - %dMhz (%d steps)\n", 
-				cpu->cpuid,
-				cpu->min_speed / 1000, 
-				cpu->max_speed / 1000, 
-				cpu->table_size);
-		for(j=0;j<cpu->table_size; j++) {
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &init_end);
+
+	state_load(ncpus);
+	glitch_new_session();
+
+	pprintf(0,"Found %d cpufreq polic%s for %d CPU%s, initialised in %.1f ms\n",
+			npolicies,
+			(npolicies>1)?"ies":"y",
+			ncpus,
+			(ncpus>1)?"s":"",
+			(init_end.tv_sec - init_start.tv_sec) * 1e3
+			+ (init_end.tv_nsec - init_start.tv_nsec) / 1e6);
+	
+	for (i=0;i<npolicies;i++) {
+		pol = policies[i];
+		pprintf(0,"  policy%d (%d CPU%s): %dMhz - %dMhz (%d steps)\n", 
+				pol->id,
+				pol->ncpus,
+				(pol->ncpus>1)?"s":"",
+				pol->min_speed / 1000, 
+				pol->max_speed / 1000, 
+				pol->table_size);
+		for(j=0;j<pol->table_size; j++) {
 			pprintf(4, "     step%d : %ldMhz\n", j+1, 
-					cpu->freq_table[j] / 1000);
+					pol->freq_table[j] / 1000);
 		}
 	}
+	if ((err = cpuidle_init(ncpus)) != 0) {
+		printf("JACKfreqd encountered and error and could not start.\n");
+		exit(err);
+	}
+	if (shadow) {
+		if ((err = shadow_init()) != 0) {
+			printf("JACKfreqd encountered and error and could not start.\n");
+			exit(err);
+		}
+		pprintf(0, "Shadow mode: deciding without changing anything\n");
+	}
+	energy_init();
+	turbo_init();
+	uncore_init();
+	if ((err = status_init()) != 0)
+		pprintf(1, "Can't publish the status: %s\n", strerror(err));
+
 	jack_server_process.pid = 0;
 
 	/* need to deaemonize before connecting to jackd */
 	if (daemonize)
 		daemon(0, 0);
 
+	/* after the fork: neither threads nor realtime scheduling survive it */
+	if (async_log && (err = log_start()) != 0)
+		pprintf(1, "Can't start the logger thread: %s\n", strerror(err));
+	rt_init();
+	psi_start();
+	hotplug_start(ncpus);
+
 	/* now that everything's all set up, lets set up a exit handler */
 	signal(SIGTERM, terminate);
 	signal(SIGINT, terminate);
+	if ((err = start_dump_requests()) != 0)
+		pprintf(1, "Can't wait for dump requests: %s\n", strerror(err));
 	
 	start_time = time(NULL);
 
 	pthread_mutex_lock(&poll_wait_lock);
 
 	/* Now the main program loop */
+	last_save_ns = monotonic_ns();
+	interval = last_interval = poll;
 	while(run) {
 		clock_gettime(CLOCK_REALTIME, &pollts);
-		pollts.tv_sec += poll/1000;
-		if (pollts.tv_nsec + ((poll%1000)*1000000) >= 1000000000) {
+		pollts.tv_sec += interval/1000;
+		if (pollts.tv_nsec + ((interval%1000)*1000000) >= 1000000000) {
 			pollts.tv_sec += 1;
 		}
-		pollts.tv_nsec = (pollts.tv_nsec + ((poll%1000)*1000000))%1000000000;
-		pthread_cond_timedwait(&jack_trigger_cond, &poll_wait_lock, &pollts);
-
-		if (! jjack_is_open()) {
-		  if (! jack_server_process.pid) {
-		    get_jack_proc(filter_uid, filter_gid, &jack_server_process);
-
-		    if (!jack_server_process.pid)
-		      if (jack_reconnect)
-			continue;
-		      else {
-			pprintf(0, "No JACK-process detected.\n");
+		pollts.tv_nsec = (pollts.tv_nsec + ((interval%1000)*1000000))%1000000000;
+		deadline_ns = monotonic_ns() + interval * 1000000LL;
+		if (!__atomic_load_n(&wake_reasons, __ATOMIC_RELAXED)
+				&& pthread_cond_timedwait(&jack_trigger_cond,
+					&poll_wait_lock, &pollts) == ETIMEDOUT)
+			rt_wakeup_late(monotonic_ns() - deadline_ns);
+
+		reasons = __atomic_exchange_n(&wake_reasons, WAKE_TIMEOUT, __ATOMIC_RELAXED);
+		event_ns = __atomic_exchange_n(&wake_event_ns, 0, __ATOMIC_RELAXED);
+		wakeup_count++;
+		interval = poll;
+
+		/* before anything looks at the policies */
+		hotplug_poll(monotonic_ns());
+		handle_hotplug(ncpus);
+
+		if (load_source != LOAD_ALSA && ! jjack_is_open()
+				&& (err = connect_jack(&jack_server_process,
+						filter_uid, filter_gid))
+				&& load_source == LOAD_JACK) {
+			if (jack_reconnect)
+				continue;
+			pprintf(0, "%s\n", err == ESRCH ? "No JACK-process detected."
+					: "Failed to connect to jackd");
 			break;
-		      }
-		  }
-		  if (jjack_open(&jack_server_process))
-		    if (jack_reconnect)
-		      continue;
-		    else {
-		      pprintf(0, "Failed to connect to jackd\n");
-		      break;
-		    }
 		}
 
 		float jack_load = jjack_poll();
+		if (load_source != LOAD_JACK) {
+			float alsa_load = poll_alsa();
+
+			if (alsa_load > jack_load)
+				jack_load = alsa_load;
+		}
 
-		if (shutdown) {
+		if (server_shutdown) {
+		  if (session_is_idle)
+		    leave_idle(0);
 		  jjack_close();
+		  cpuidle_release();
+		  turbo_release();
+		  uncore_release();
+		  perfsens_close();
+		  psi_watch_pid(0);
+		  cgroup_load_close();
+		  unlock_policies();
+		  publish_status(reasons, 0, interval, monotonic_ns());
 		  if (jack_reconnect) {
 		    /* force jjack_open() to call get_jack_uid() on server restart */
 		    jack_server_process.pid = 0;
-		    shutdown=0;
+		    server_shutdown=0;
 		    continue;
 		  } else
 		    break;
 		}
 
-		pprintf(4, "dsp load: %.3f\n", jack_load);
+		pprintf(4, "dsp load: %.3f, wake reasons: %#x\n", jack_load, reasons);
 
-		for(i=0; i<num_real_cpus; i++) {
+		energy_sample();
+		now_ns = monotonic_ns();
+		if (session_idle(jack_load, now_ns)) {
+			if (!session_is_idle)
+				enter_idle();
+			energy_account(&idle_acct);
+		} else if (session_is_idle) {
+			leave_idle(reasons);
+		}
+
+		if (!session_is_idle) {
+			update_irq_floors(tick_seconds);
+			cpuidle_update(load_pid(&jack_server_process), period_usecs(), jack_load);
+		}
+		if (!session_is_idle && (reasons & WAKE_SESSION_EDIT))
+			session_edit(load_pid(&jack_server_process), jack_load, now_ns);
+		xruns = total_xruns();
+		if (!session_is_idle && limits_update(xruns - last_xruns, now_ns))
+			switch_actuator();
+		if (now_ns < edit_until_ns)
+			edit_xruns += xruns - last_xruns;
+		last_xruns = xruns;
+		glitch_update(now_ns);
+		flightrec_tick(reasons, jack_load, last_interval);
+
+		if (!session_is_idle) {
+			freq_sensitivity = perfsens_update(jack_khz());
+			cgroup_load_sample();
+		}
+		for(i=0; !session_is_idle && i<npolicies; i++) {
 			change = LOWER;
-			cpubase = i*threads_per_core;
-			pprintf(4, "i = %d, cpubase = %d, ",i,cpubase);
+			pol = policies[i];
+			verify_speed(pol);
+			model_update(pol, jack_load);
+			sensitivity_target(pol, jack_load);
+			if (pol->transition_unsafe) {
+				if (!pol->transition_locked)
+					lock_policy(pol);
+				continue;
+			}
+			if (pol->boosted && now_ns >= boost_until_ns)
+				unboost_policy(pol, jack_load);
+			pprintf(4, "i = %d, policy = %d, ",i,pol->id);
 			/* handle SMT/CMP here */
-			for (j=0; j<all_cpus[cpubase]->threads_per_core; j++) {
-				change2 = decide_speed(all_cpus[cpubase+j], jack_load);
+			for (j=0; j<pol->ncpus; j++) {
+				change2 = decide_speed(all_cpus[pol->cpus[j]], jack_load);
 				pprintf(4, "change = %d, change2 = %d\n",change,change2);
 				if (change2 > change)
 					change = change2;
 			}
-			if (change != SAME) {
-				if ((err=change_speed(all_cpus[cpubase], change))) {
+			/* tasks are waiting for the cpu right now */
+			if (reasons & WAKE_PRESSURE) {
+				pol->target_index = 0;
+				change = RAISE;
+			}
+			if (pol->boosted && change == LOWER)
+				change = SAME;
+			/* a faster clock would barely lower the load */
+			if (pol->is_pstate && change == RAISE && freq_insensitive())
+				change = SAME;
+			if (irq_floor(pol, &change) || change != SAME) {
+				if ((err=change_speed(pol, change))) {
 					pprintf(2, "changing CPU speed failed.\n");
 				} else {
 					pprintf(2, "changed CPU speed %s\n", change < SAME ? "LOWER" : "UP");
 				}
 			}
+			flightrec_policy(pol->id, change, pol->is_pstate
+					? pol->current_pstate_mode : pol->current_speed,
+					change != SAME ? pol->write_latency_ns : 0, jack_load);
+		}
+		if (!session_is_idle) {
+			turbo_update(jack_load, all_policies_at_max(), now_ns);
+			uncore_update(jack_load, now_ns);
+		}
+
+		if (event_ns) {
+			double ms = (monotonic_ns() - event_ns) / 1e6;
+
+			reaction_count++;
+			reaction_sum_ms += ms;
+			if (reasons & WAKE_PRESSURE)
+				psi_reacted(ms);
+			if (ms > reaction_max_ms)
+				reaction_max_ms = ms;
+		}
+		if (dump_requested) {
+			dump_requested = 0;
+			flightrec_dump("request");
+		} else if ((reasons & WAKE_XRUN)
+				&& now_ns - last_dump_ns >= FLIGHTREC_DUMP_INTERVAL) {
+			last_dump_ns = now_ns;
+			flightrec_dump("xrun");
+		}
+		interval = next_poll_interval(last_interval, jack_load, prev_load);
+		if (session_is_idle && interval < poll_max)
+			interval = poll_max;
+		last_interval = interval;
+		prev_load = jack_load;
+		/* end the boost on time, not up to a poll interval late */
+		if (boost_until_ns > now_ns
+				&& interval > (boost_until_ns - now_ns + 999999) / 1000000)
+			interval = (boost_until_ns - now_ns + 999999) / 1000000;
+		if (shadow)
+			shadow_tick(tick_seconds, session_is_idle
+					&& idle_posture == IDLE_KERNEL);
+		publish_status(reasons, jack_load, interval, now_ns);
+
+		if (now_ns - last_save_ns >= STATE_SAVE_INTERVAL * 1000000000LL) {
+			last_save_ns = now_ns;
+			if ((err = state_save(ncpus)) != 0)
+				pprintf(1, "Can't save the learned state: %s\n", strerror(err));
 		}
 	}
 
@@ -0,0 +1,86 @@
+/*
+ * The jackfreqd status page reader library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "jackfreqd_status.h"
+
+#define READ_RETRIES 1000
+
+struct jfd_status_reader {
+	const jfd_status_t *page;
+	size_t size;
+};
+
+jfd_status_reader_t *jfd_status_open(const char *path) {
+	jfd_status_reader_t *r;
+	int fd, err;
+
+	if ((r = (jfd_status_reader_t *)calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+	if ((fd = open(path ? path : JFD_STATUS_PATH, O_RDONLY)) < 0) {
+		err = errno;
+		free(r);
+		errno = err;
+		return NULL;
+	}
+	r->size = sizeof(jfd_status_t);
+	r->page = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);
+	if (r->page == MAP_FAILED) {
+		free(r);
+		errno = err;
+		return NULL;
+	}
+	return r;
+}
+
+int jfd_status_read(jfd_status_reader_t *r, jfd_status_t *snapshot) {
+	uint32_t seq;
+	int i;
+
+	for (i = 0; i < READ_RETRIES; i++) {
+		seq = __atomic_load_n(&r->page->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(snapshot, r->page, sizeof(*snapshot));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&r->page->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (snapshot->magic != JFD_STATUS_MAGIC
+		    || snapshot->version < JFD_STATUS_VERSION
+		    || snapshot->size < sizeof(jfd_status_t))
+			return EPROTO;
+		return 0;
+	}
+	return EAGAIN;
+}
+
+void jfd_status_close(jfd_status_reader_t *r) {
+	if (!r)
+		return;
+	munmap((void *)r->page, r->size);
+	free(r);
+}
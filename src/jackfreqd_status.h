@@ -0,0 +1,101 @@
+/*
+ * The jackfreqd status page: layout and reader library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef JACKFREQD_STATUS_H
+#define JACKFREQD_STATUS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * jackfreqd publishes its state in a memory-mapped file. The layout is
+ * fixed per version: fields are only ever appended, size grows with
+ * them. The writer makes seq odd while it updates the page, readers
+ * copy the page and retry if seq was odd or changed meanwhile.
+ */
+#define JFD_STATUS_PATH "/run/jackfreqd/status"
+#define JFD_STATUS_MAGIC 0x4a465354 /* "JFST" */
+#define JFD_STATUS_VERSION 1
+#define JFD_STATUS_MAX_POLICIES 64
+
+/* jfd_status_policy_t flags */
+#define JFD_POLICY_PSTATE   0x01  /* intel_pstate, mode instead of speed */
+#define JFD_POLICY_BOOSTED  0x02  /* preemptively boosted */
+#define JFD_POLICY_UNSAFE   0x04  /* transitions cause glitches */
+#define JFD_POLICY_LOCKED   0x08  /* speed held for the session */
+
+typedef struct jfd_status_policy {
+	uint32_t id;            /* the first cpu */
+	uint32_t ncpus;
+	uint32_t cur_khz;
+	uint32_t min_khz;
+	uint32_t max_khz;
+	int32_t mode;           /* 0 lower, 1 same, 2 raise */
+	uint32_t flags;
+	uint32_t transitions;
+	int64_t last_change_ns; /* CLOCK_MONOTONIC, 0 - never */
+} jfd_status_policy_t;
+
+typedef struct jfd_status {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;          /* of this structure */
+	uint32_t seq;
+	int64_t update_ns;      /* CLOCK_MONOTONIC of the last tick */
+	uint64_t ticks;
+	float dsp_load;         /* percent, the statistic the governor uses */
+	uint32_t jack_connected;
+	uint32_t period_usecs;
+	uint32_t wake_reasons;  /* of the last tick */
+	uint32_t poll_ms;       /* until the next tick */
+	uint32_t npolicies;
+	uint64_t speed_changes;
+	uint64_t xruns;
+	uint64_t wakeups;
+	uint64_t drifts;
+	uint64_t pruned;
+	uint64_t log_dropped;
+	jfd_status_policy_t policies[JFD_STATUS_MAX_POLICIES];
+} jfd_status_t;
+
+typedef struct jfd_status_reader jfd_status_reader_t;
+
+/**
+ * Map the status page.
+ * @param path NULL for JFD_STATUS_PATH
+ * @return NULL with errno set on failure
+ */
+extern jfd_status_reader_t *jfd_status_open(const char *path);
+
+/**
+ * Take a consistent snapshot of the page, no system calls.
+ * @return 0, EAGAIN if the writer kept it busy, EPROTO if the
+ *   daemon is older than this library
+ */
+extern int jfd_status_read(jfd_status_reader_t *r, jfd_status_t *snapshot);
+
+extern void jfd_status_close(jfd_status_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JACKFREQD_STATUS_H */
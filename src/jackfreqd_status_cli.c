@@ -0,0 +1,129 @@
+/*
+ * jackfreqd-status: print the status page of a running jackfreqd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "jackfreqd_status.h"
+
+static const char *const mode_names[] = {"lower", "same", "raise"};
+
+void help(void) {
+	printf("jackfreqd-status: print the state of a running jackfreqd\n");
+	printf("\nAvailable Options:\n");
+	printf(" -h        Print this help message\n");
+	printf(" -f file   Status page (default = %s)\n", JFD_STATUS_PATH);
+	printf(" -w #      Print every # msecs until interrupted\n");
+	printf("\n");
+}
+
+static double age(int64_t ns) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1000000000LL + now.tv_nsec - ns) / 1e9;
+}
+
+static void print_status(const jfd_status_t *st) {
+	unsigned int i;
+
+	printf("tick %llu, %.3f s ago, next in %u ms\n",
+	    (unsigned long long)st->ticks, age(st->update_ns), st->poll_ms);
+	if (st->jack_connected)
+		printf("JACK: DSP load %.1f%%, period %u us, woken by %#x\n",
+		    st->dsp_load, st->period_usecs, st->wake_reasons);
+	else
+		printf("JACK: not connected\n");
+	printf("counters: %llu speed changes, %llu xruns, %llu wakeups, "
+	    "%llu drifts, %llu pruned, %llu log messages dropped\n",
+	    (unsigned long long)st->speed_changes,
+	    (unsigned long long)st->xruns, (unsigned long long)st->wakeups,
+	    (unsigned long long)st->drifts, (unsigned long long)st->pruned,
+	    (unsigned long long)st->log_dropped);
+
+	for (i = 0; i < st->npolicies && i < JFD_STATUS_MAX_POLICIES; i++) {
+		const jfd_status_policy_t *p = &st->policies[i];
+
+		printf("policy %u (%u cpus): ", p->id, p->ncpus);
+		if (p->flags & JFD_POLICY_PSTATE)
+			printf("pstate %s", p->mode >= 0 && p->mode <= 2
+			    ? mode_names[p->mode] : "?");
+		else
+			printf("%u kHz [%u .. %u]", p->cur_khz, p->min_khz,
+			    p->max_khz);
+		printf(", %u transitions", p->transitions);
+		if (p->last_change_ns)
+			printf(", last %.1f s ago", age(p->last_change_ns));
+		printf("%s%s%s\n",
+		    p->flags & JFD_POLICY_BOOSTED ? ", boosted" : "",
+		    p->flags & JFD_POLICY_UNSAFE ? ", transition-unsafe" : "",
+		    p->flags & JFD_POLICY_LOCKED ? ", locked" : "");
+	}
+}
+
+int main(int argc, char **argv) {
+	jfd_status_reader_t *r;
+	jfd_status_t st;
+	const char *path = NULL;
+	unsigned int watch = 0;
+	int c, err;
+
+	while ((c = getopt(argc, argv, "f:w:h")) != -1) {
+		switch (c) {
+			case 'f':
+				path = optarg;
+				break;
+			case 'w':
+				watch = strtoul(optarg, NULL, 10);
+				break;
+			case 'h':
+				help();
+				exit(0);
+			default:
+				help();
+				exit(ENOTSUP);
+		}
+	}
+
+	if ((r = jfd_status_open(path)) == NULL) {
+		err = errno;
+		fprintf(stderr, "Can't open %s: %s\n",
+		    path ? path : JFD_STATUS_PATH, strerror(err));
+		exit(err);
+	}
+
+	do {
+		if ((err = jfd_status_read(r, &st)) != 0) {
+			fprintf(stderr, "Can't read the status: %s\n", strerror(err));
+			break;
+		}
+		print_status(&st);
+		if (watch) {
+			printf("\n");
+			fflush(stdout);
+			usleep(watch * 1000);
+		}
+	} while (watch);
+
+	jfd_status_close(r);
+	return err;
+}
@@ -0,0 +1,64 @@
+/*
+ * Streaming DSP load histogram
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <string.h>
+
+#include "load_hist.h"
+
+void load_hist_reset(load_hist_t *h) {
+	memset(h, 0, sizeof(load_hist_t));
+}
+
+void load_hist_merge(load_hist_t *dst, const load_hist_t *src) {
+	int b;
+
+	for (b = 0; b < LOAD_HIST_BUCKETS; b++)
+		dst->count[b] += src->count[b];
+	dst->total += src->total;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+float load_hist_quantile(const load_hist_t *h, float q) {
+	unsigned long long rank, seen = 0;
+	int b;
+
+	if (!h->total)
+		return 0.0;
+	if (q >= 1.0)
+		return h->max;
+
+	/* the smallest bucket covering ceil(q * total) samples */
+	rank = (unsigned long long)(q * h->total + 0.999999);
+	if (rank < 1)
+		rank = 1;
+
+	for (b = 0; b < LOAD_HIST_BUCKETS; b++) {
+		seen += h->count[b];
+		if (seen >= rank)
+			break;
+	}
+	if (b >= LOAD_HIST_BUCKETS - 1)
+		return h->max;
+
+	/* never report more than what was actually seen */
+	{
+		float edge = (float)(b + 1) / LOAD_HIST_RESOLUTION;
+		return edge < h->max ? edge : h->max;
+	}
+}
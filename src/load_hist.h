@@ -0,0 +1,72 @@
+/*
+ * Streaming DSP load histogram
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef LOAD_HIST_H
+#define LOAD_HIST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed buckets of 1/LOAD_HIST_RESOLUTION percent. Loads above the last
+ * bucket (overloaded cycles) are clamped into it, the exact maximum is
+ * kept separately.
+ */
+#define LOAD_HIST_RESOLUTION 2
+#define LOAD_HIST_BUCKETS (128 * LOAD_HIST_RESOLUTION)
+
+typedef struct load_hist {
+	unsigned int count[LOAD_HIST_BUCKETS];
+	unsigned int total;
+	float max;
+} load_hist_t;
+
+/**
+ * Add one sample (in percent). Constant time, no locking, no syscalls:
+ * safe to call from the JACK process thread as long as there is only
+ * one writer per histogram.
+ */
+static inline void load_hist_add(load_hist_t *h, float load) {
+	int b = (int)(load * LOAD_HIST_RESOLUTION);
+
+	if (b < 0)
+		b = 0;
+	else if (b >= LOAD_HIST_BUCKETS)
+		b = LOAD_HIST_BUCKETS - 1;
+	h->count[b]++;
+	h->total++;
+	if (load > h->max)
+		h->max = load;
+}
+
+extern void load_hist_reset(load_hist_t *h);
+extern void load_hist_merge(load_hist_t *dst, const load_hist_t *src);
+
+/**
+ * Estimate a quantile of the recorded samples.
+ * @param q the quantile [0 .. 1]. 1 returns the exact maximum.
+ * @return the load in percent (upper edge of the bucket), 0 if empty
+ */
+extern float load_hist_quantile(const load_hist_t *h, float q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOAD_HIST_H */
@@ -0,0 +1,168 @@
+/*
+ * Asynchronous logging through a lock-free ring and a logger thread
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "globals.h"
+#include "logger.h"
+
+/*
+ * A bounded multi-producer queue: a slot is free for the producer that
+ * claims position pos when its seq equals pos, and ready for the logger
+ * when it equals pos + 1. Producers never wait: a full ring drops.
+ */
+typedef struct log_slot {
+	unsigned int seq;
+	char msg[LOG_SLOT_SIZE];
+} log_slot_t;
+
+static log_slot_t slots[LOG_SLOTS];
+static unsigned int head = 0;   /* next position to claim */
+static unsigned int tail = 0;   /* next position to ship, logger only */
+static unsigned int dropped = 0;
+
+static int running = 0;
+static int stopping = 0;
+static sem_t pending;
+static pthread_t logger_thread;
+
+static void ship(const char *msg) {
+	if (daemonize)
+		syslog(LOG_INFO, "%s", msg);
+	else
+		fputs(msg, stdout);
+}
+
+static void drain(void) {
+	log_slot_t *s;
+
+	for (;;) {
+		s = &slots[tail & (LOG_SLOTS - 1)];
+		if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+		ship(s->msg);
+		__atomic_store_n(&s->seq, tail + LOG_SLOTS, __ATOMIC_RELEASE);
+		tail++;
+	}
+	if (!daemonize)
+		fflush(stdout);
+}
+
+static void *logger(void *arg) {
+	sigset_t all;
+
+	/* signals are for the main loop */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+	/* the logger's timing does not matter, the governor's does */
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		sem_wait(&pending);
+		drain();
+	}
+	drain();
+	return NULL;
+}
+
+void log_printf(int level, const char *fmt, ...) {
+	va_list ap;
+	unsigned int pos;
+	log_slot_t *s;
+
+	va_start(ap, fmt);
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		if (daemonize)
+			vsyslog(LOG_INFO, fmt, ap);
+		else
+			vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	for (;;) {
+		s = &slots[pos & (LOG_SLOTS - 1)];
+		unsigned int seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 0,
+			    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if ((int)(seq - pos) < 0) {
+			/* still holding a record from the last lap: full */
+			__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+			va_end(ap);
+			return;
+		} else {
+			pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* the slot is ours until seq moves on: format straight into it */
+	vsnprintf(s->msg, sizeof(s->msg), fmt, ap);
+	va_end(ap);
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&pending);
+}
+
+int log_start(void) {
+	unsigned int i;
+	int err;
+
+	if (running)
+		return 0;
+	for (i = 0; i < LOG_SLOTS; i++)
+		slots[i].seq = i;
+	head = tail = 0;
+	stopping = 0;
+	if (sem_init(&pending, 0, 0) != 0)
+		return errno;
+	if ((err = pthread_create(&logger_thread, NULL, logger, NULL)) != 0) {
+		sem_destroy(&pending);
+		return err;
+	}
+	__atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void log_stop(void) {
+	if (!running)
+		return;
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	sem_post(&pending);
+	pthread_join(logger_thread, NULL);
+	sem_destroy(&pending);
+}
+
+unsigned int log_dropped(void) {
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
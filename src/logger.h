@@ -0,0 +1,47 @@
+/*
+ * Asynchronous logging through a lock-free ring and a logger thread
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_SLOTS 1024     /* a power of 2 */
+#define LOG_SLOT_SIZE 240  /* longer messages are truncated */
+
+/**
+ * Start the logger thread. Until then, and after log_stop(), pprintf()
+ * writes synchronously. Start it after daemon(): threads don't survive
+ * the fork.
+ * @return 0 or errno
+ */
+extern int log_start(void);
+
+/* ship the records still queued, stop the thread, go synchronous again */
+extern void log_stop(void);
+
+/* the number of records dropped because the ring was full */
+extern unsigned int log_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_H */
@@ -0,0 +1,307 @@
+/*
+ * Frequency sensitivity of the JACK threads from perf_event counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "globals.h"
+#include "perfsens.h"
+
+#define MAX_PERF_THREADS 32
+
+/*
+ * Without a stall counter every last level cache miss is taken to stall
+ * the core for about one memory latency, which doesn't scale with the
+ * core clock.
+ */
+#define MISS_LATENCY_NS 80
+#define SENS_GAIN 0.2        /* of the moving average */
+#define SENS_MIN_CYCLES 1000000
+/* the task clock regression forgets old samples at this rate per tick */
+#define SENS_DECAY 0.98
+#define SENS_MIN_TICKS 8
+
+enum counters { C_CYCLES, C_INSTRUCTIONS, C_STALLS, NCOUNTERS };
+
+enum perf_kinds {
+	PERF_NONE,
+	PERF_STALLS,   /* cycles, instructions, stalled-cycles-backend */
+	PERF_MISSES,   /* cycles, instructions, cache misses */
+	PERF_SOFTWARE  /* task clock only */
+};
+
+static const char *const kind_names[] = {
+	"none", "stalled cycles", "cache misses", "task clock"
+};
+
+typedef struct perf_thread {
+	int tid;
+	int fds[NCOUNTERS];
+	uint64_t last[NCOUNTERS];
+	uint64_t last_running;
+} perf_thread_t;
+
+unsigned int perf_sens_pct = 0;
+
+static perf_thread_t threads[MAX_PERF_THREADS];
+static int nthreads = 0;
+static int kind = PERF_NONE;
+static float sensitivity = -1;
+static long long last_ns = 0;
+/* the task clock fallback: least squares of busy = a / f + b */
+static double sx, sy, sxx, sxy, sn;
+static unsigned int samples = 0;
+
+static int perf_open(int tid, uint32_t type, uint64_t config, int group) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, tid, -1, group, 0);
+}
+
+static void close_thread(perf_thread_t *t) {
+	int c;
+
+	for (c = NCOUNTERS - 1; c >= 0; c--)
+		if (t->fds[c] >= 0)
+			close(t->fds[c]);
+}
+
+/* open the counters of kind k on the thread, 0 or errno */
+static int open_thread(perf_thread_t *t, int tid, int k) {
+	int c;
+
+	t->tid = tid;
+	for (c = 0; c < NCOUNTERS; c++)
+		t->fds[c] = -1;
+
+	if (k == PERF_SOFTWARE) {
+		t->fds[C_CYCLES] = perf_open(tid, PERF_TYPE_SOFTWARE,
+				PERF_COUNT_SW_TASK_CLOCK, -1);
+	} else {
+		t->fds[C_CYCLES] = perf_open(tid, PERF_TYPE_HARDWARE,
+				PERF_COUNT_HW_CPU_CYCLES, -1);
+		if (t->fds[C_CYCLES] >= 0)
+			t->fds[C_INSTRUCTIONS] = perf_open(tid, PERF_TYPE_HARDWARE,
+					PERF_COUNT_HW_INSTRUCTIONS, t->fds[C_CYCLES]);
+		if (t->fds[C_INSTRUCTIONS] >= 0)
+			t->fds[C_STALLS] = perf_open(tid, PERF_TYPE_HARDWARE,
+					k == PERF_STALLS ? PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+					: PERF_COUNT_HW_CACHE_MISSES, t->fds[C_CYCLES]);
+		if (t->fds[C_STALLS] < 0) {
+			int err = errno;
+
+			close_thread(t);
+			return err;
+		}
+	}
+	if (t->fds[C_CYCLES] < 0)
+		return errno;
+	memset(t->last, 0, sizeof(t->last));
+	t->last_running = 0;
+	return 0;
+}
+
+/* the realtime threads of the process */
+static int find_threads(int pid, int *tids, int max) {
+	char path[64];
+	struct dirent *de;
+	DIR *dir;
+	int n = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	if ((dir = opendir(path)) == NULL)
+		return 0;
+	while (n < max && (de = readdir(dir)) != NULL) {
+		int tid = atoi(de->d_name), policy;
+
+		if (tid <= 0)
+			continue;
+		policy = sched_getscheduler(tid) & ~SCHED_RESET_ON_FORK;
+		if (policy == SCHED_FIFO || policy == SCHED_RR)
+			tids[n++] = tid;
+	}
+	closedir(dir);
+	return n;
+}
+
+int perfsens_open(int pid) {
+	static const int kinds[] = {PERF_STALLS, PERF_MISSES, PERF_SOFTWARE};
+	int tids[MAX_PERF_THREADS], n, i, k, err = 0;
+
+	perfsens_close();
+	if (!perf_sens_pct || !pid)
+		return 0;
+	sensitivity = -1;
+	sx = sy = sxx = sxy = sn = 0;
+
+	if ((n = find_threads(pid, tids, MAX_PERF_THREADS)) == 0) {
+		pprintf(2, "No realtime threads in process %d to count\n", pid);
+		return 0;
+	}
+	/* the first kind the first thread takes is used for all */
+	for (k = 0; k < 3; k++)
+		if ((err = open_thread(&threads[0], tids[0], kinds[k])) == 0)
+			break;
+	if (k == 3) {
+		pprintf(1, "Can't count the JACK threads: %s\n", strerror(err));
+		return 0;
+	}
+	kind = kinds[k];
+	nthreads = 1;
+	for (i = 1; i < n; i++)
+		if (open_thread(&threads[nthreads], tids[i], kind) == 0)
+			nthreads++;
+	pprintf(2, "Counting %s on %d realtime threads of process %d\n",
+			kind_names[kind], nthreads, pid);
+	return nthreads;
+}
+
+void perfsens_close(void) {
+	int i;
+
+	for (i = 0; i < nthreads; i++)
+		close_thread(&threads[i]);
+	nthreads = 0;
+	last_ns = 0;
+}
+
+/* sum the deltas of all threads, running time in ns */
+static int read_deltas(uint64_t *delta, uint64_t *running) {
+	uint64_t buf[2 + NCOUNTERS];
+	int i, c, n = 0;
+
+	memset(delta, 0, NCOUNTERS * sizeof(*delta));
+	*running = 0;
+	for (i = 0; i < nthreads; i++) {
+		perf_thread_t *t = &threads[i];
+
+		/* nr, time_running, the values */
+		if (read(t->fds[C_CYCLES], buf, sizeof(buf)) < 16)
+			continue;
+		for (c = 0; c < (int)buf[0] && c < NCOUNTERS; c++) {
+			delta[c] += buf[2 + c] - t->last[c];
+			t->last[c] = buf[2 + c];
+		}
+		*running += buf[1] - t->last_running;
+		t->last_running = buf[1];
+		n++;
+	}
+	return n;
+}
+
+static void smooth(float s) {
+	if (s < 0)
+		s = 0;
+	if (s > 1)
+		s = 1;
+	sensitivity = sensitivity < 0 ? s : sensitivity + SENS_GAIN * (s - sensitivity);
+	samples++;
+}
+
+float perfsens_update(unsigned long khz) {
+	uint64_t delta[NCOUNTERS], running;
+	long long now = monotonic_ns();
+	double stalls, x, y, det, a, b;
+
+	if (!nthreads || !read_deltas(delta, &running))
+		return sensitivity;
+
+	if (!last_ns) {
+		/* the first deltas run from the opening */
+		last_ns = now;
+		return sensitivity;
+	}
+
+	if (kind != PERF_SOFTWARE) {
+		if (delta[C_CYCLES] < SENS_MIN_CYCLES || !running)
+			goto out;
+		if (kind == PERF_STALLS) {
+			stalls = delta[C_STALLS];
+		} else {
+			/* the clock the threads actually ran at */
+			double hz = delta[C_CYCLES] * 1e9 / running;
+
+			stalls = delta[C_STALLS] * MISS_LATENCY_NS * 1e-9 * hz;
+		}
+		smooth(1.0 - stalls / delta[C_CYCLES]);
+		pprintf(4, "perf: %llu cycles, %.2f IPC, %.0f%% stalled, sensitivity %.2f\n",
+				(unsigned long long)delta[C_CYCLES],
+				(double)delta[C_INSTRUCTIONS] / delta[C_CYCLES],
+				100.0 * stalls / delta[C_CYCLES], sensitivity);
+		goto out;
+	}
+
+	/* task clock: busy fraction against 1/f, it takes speed changes */
+	if (!khz || now <= last_ns)
+		goto out;
+	x = 1e6 / khz;
+	y = (double)delta[C_CYCLES] / (now - last_ns);
+	sx = sx * SENS_DECAY + x;
+	sy = sy * SENS_DECAY + y;
+	sxx = sxx * SENS_DECAY + x * x;
+	sxy = sxy * SENS_DECAY + x * y;
+	sn = sn * SENS_DECAY + 1;
+	det = sn * sxx - sx * sx;
+	/* no estimate until the speed has moved a few times */
+	if (sn < SENS_MIN_TICKS || det <= 1e-9 * sn * sxx)
+		goto out;
+	a = (sn * sxy - sx * sy) / det;
+	b = (sy - a * sx) / sn;
+	if (a * x + b > 0) {
+		sensitivity = a * x / (a * x + b);
+		if (sensitivity < 0)
+			sensitivity = 0;
+		if (sensitivity > 1)
+			sensitivity = 1;
+		samples++;
+	}
+	pprintf(4, "perf: busy %.3f at %lu kHz, sensitivity %.2f\n", y, khz,
+			sensitivity);
+out:
+	last_ns = now;
+	return sensitivity;
+}
+
+void perfsens_report(int level) {
+	if (!perf_sens_pct)
+		return;
+	if (sensitivity < 0)
+		pprintf(level, "  frequency sensitivity: unknown\n");
+	else
+		pprintf(level, "  frequency sensitivity: %.2f from %u samples of %s\n",
+				sensitivity, samples, kind_names[kind]);
+}
@@ -0,0 +1,53 @@
+/*
+ * Frequency sensitivity of the JACK threads from perf_event counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef PERFSENS_H
+#define PERFSENS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* below this sensitivity in percent raising the clock stops, 0 - off */
+extern unsigned int perf_sens_pct;
+
+/**
+ * Open counters on the realtime threads of the JACK server: cycles,
+ * instructions and backend stalls or cache misses, or the task clock
+ * where there are no hardware counters.
+ * @return the number of threads counted
+ */
+extern int perfsens_open(int pid);
+
+extern void perfsens_close(void);
+
+/**
+ * Fold the counts since the last call into the estimate.
+ * @param khz the speed the JACK cpus ran at, for the task clock fallback
+ * @return the share of the JACK threads' time that scales with 1/f,
+ *   0 to 1, or -1 while unknown
+ */
+extern float perfsens_update(unsigned long khz);
+
+extern void perfsens_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERFSENS_H */
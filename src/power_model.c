@@ -0,0 +1,120 @@
+/*
+ * A frequency versus power model of a cpu package
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "power_model.h"
+
+#define DEFAULT_IDLE_WATTS 2.0
+#define DEFAULT_MAX_DYNAMIC_WATTS 25.0
+#define DEFAULT_POINTS 8
+
+static int compare_points(const void *a, const void *b) {
+	const power_point_t *pa = a, *pb = b;
+
+	return (pa->khz > pb->khz) - (pa->khz < pb->khz);
+}
+
+int power_model_load(const char *file, power_model_t *m) {
+	char line[200];
+	FILE *f;
+	power_point_t *pt;
+
+	if ((f = fopen(file, "r")) == NULL)
+		return errno;
+
+	m->npoints = 0;
+	while (fgets(line, sizeof(line), f)) {
+		char *c = strchr(line, '#');
+
+		if (c)
+			*c = '\0';
+		if (m->npoints == POWER_MODEL_MAX_POINTS)
+			break;
+		pt = &m->points[m->npoints];
+		if (sscanf(line, "%lu %lf %lf", &pt->khz, &pt->idle_watts,
+		    &pt->busy_watts) == 3)
+			m->npoints++;
+	}
+	fclose(f);
+
+	if (!m->npoints)
+		return EINVAL;
+	qsort(m->points, m->npoints, sizeof(power_point_t), compare_points);
+	return 0;
+}
+
+void power_model_default(power_model_t *m,
+		unsigned long min_khz, unsigned long max_khz) {
+	int i;
+
+	m->npoints = DEFAULT_POINTS;
+	for (i = 0; i < DEFAULT_POINTS; i++) {
+		power_point_t *pt = &m->points[i];
+		double r;
+
+		pt->khz = min_khz + (max_khz - min_khz) * i / (DEFAULT_POINTS - 1);
+		r = (double)pt->khz / max_khz;
+		pt->idle_watts = DEFAULT_IDLE_WATTS;
+		pt->busy_watts = DEFAULT_IDLE_WATTS
+		    + DEFAULT_MAX_DYNAMIC_WATTS * r * r * r;
+	}
+}
+
+void power_model_at(const power_model_t *m, unsigned long khz,
+		double *idle_watts, double *busy_watts) {
+	const power_point_t *lo, *hi;
+	double r;
+	int i;
+
+	*idle_watts = *busy_watts = 0;
+	if (!m->npoints)
+		return;
+
+	lo = hi = &m->points[m->npoints - 1];
+	for (i = 0; i < m->npoints; i++) {
+		if (m->points[i].khz >= khz) {
+			hi = &m->points[i];
+			lo = i ? &m->points[i - 1] : hi;
+			break;
+		}
+	}
+
+	if (hi == lo || khz <= lo->khz) {
+		*idle_watts = lo->idle_watts;
+		*busy_watts = lo->busy_watts;
+	} else {
+		r = (double)(khz - lo->khz) / (hi->khz - lo->khz);
+		*idle_watts = lo->idle_watts + r * (hi->idle_watts - lo->idle_watts);
+		*busy_watts = lo->busy_watts + r * (hi->busy_watts - lo->busy_watts);
+	}
+}
+
+double power_model_watts(const power_model_t *m, unsigned long khz, double util) {
+	double idle, busy;
+
+	power_model_at(m, khz, &idle, &busy);
+	if (util < 0)
+		util = 0;
+	if (util > 1)
+		util = 1;
+	return idle + util * (busy - idle);
+}
@@ -0,0 +1,71 @@
+/*
+ * A frequency versus power model of a cpu package
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef POWER_MODEL_H
+#define POWER_MODEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POWER_MODEL_MAX_POINTS 64
+
+/* the power drawn at one frequency, idle and fully busy */
+typedef struct power_point {
+	unsigned long khz;
+	double idle_watts;
+	double busy_watts;
+} power_point_t;
+
+/* points in ascending frequency, linearly interpolated in between */
+typedef struct power_model {
+	int npoints;
+	power_point_t points[POWER_MODEL_MAX_POINTS];
+} power_model_t;
+
+/**
+ * Read a model: one "kHz idle-watts busy-watts" line per frequency,
+ * '#' starts a comment.
+ * @return 0 or errno
+ */
+extern int power_model_load(const char *file, power_model_t *m);
+
+/**
+ * A generic model for when nothing was measured: a constant idle power
+ * and a dynamic power growing with the cube of the frequency (voltage
+ * rising with the frequency). Good for comparing, not for absolute watts.
+ */
+extern void power_model_default(power_model_t *m,
+		unsigned long min_khz, unsigned long max_khz);
+
+/* the idle and the fully busy power at a frequency */
+extern void power_model_at(const power_model_t *m, unsigned long khz,
+		double *idle_watts, double *busy_watts);
+
+/**
+ * The power at a frequency.
+ * @param util the busy fraction of the time [0 .. 1]
+ */
+extern double power_model_watts(const power_model_t *m,
+		unsigned long khz, double util);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POWER_MODEL_H */
@@ -0,0 +1,266 @@
+/*
+ * CPU pressure stall (PSI) triggers as a wake source
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "globals.h"
+#include "cgroup_load.h"
+#include "psi.h"
+
+#define PSI_UNPRIV_WINDOW_MS 2000
+/* a CPU load crossing later than this isn't the one PSI saw */
+#define PSI_MATCH_NS 5000000000LL
+
+enum psi_fds { FD_CONTROL, FD_SYSTEM, FD_CGROUP, NFDS };
+
+unsigned int psi_stall_ms = 0;
+
+static unsigned int window_ms = PSI_WINDOW_MS;
+
+static pthread_t psi_thread;
+static int running = 0;
+static int stopping = 0;
+static struct pollfd fds[NFDS];
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static char watch_path[PATH_MAX]; /* the cgroup file wanted, "" - none */
+
+static unsigned int events = 0;
+static long long pending_ns = 0;  /* the last event not yet matched */
+static unsigned int reacted = 0;
+static double reaction_sum_ms = 0, reaction_max_ms = 0;
+static unsigned int cpu_followed = 0, cpu_missed = 0;
+static double lead_sum_ms = 0;
+
+static int write_trigger(int fd, unsigned int window_ms) {
+	char trig[64];
+
+	snprintf(trig, sizeof(trig), "some %u %u",
+			psi_stall_ms * 1000 * (window_ms / PSI_WINDOW_MS),
+			window_ms * 1000);
+	return write(fd, trig, strlen(trig) + 1) < 0 ? errno : 0;
+}
+
+static int open_trigger(const char *path) {
+	int fd, err;
+
+	if ((fd = open(path, O_RDWR | O_NONBLOCK)) < 0)
+		return -1;
+	/*
+	 * Without CAP_SYS_RESOURCE the kernel only takes windows in whole
+	 * multiples of 2 s: keep the stall share of the window then.
+	 */
+	if ((err = write_trigger(fd, window_ms)) == EINVAL
+			&& window_ms == PSI_WINDOW_MS) {
+		window_ms = PSI_UNPRIV_WINDOW_MS;
+		pprintf(1, "Sub-second pressure windows are not permitted, "
+				"using %u ms\n", window_ms);
+		err = write_trigger(fd, window_ms);
+	}
+	if (err) {
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	return fd;
+}
+
+static void reopen_cgroup(void) {
+	char path[PATH_MAX];
+
+	pthread_mutex_lock(&watch_lock);
+	strcpy(path, watch_path);
+	pthread_mutex_unlock(&watch_lock);
+
+	if (fds[FD_CGROUP].fd >= 0)
+		close(fds[FD_CGROUP].fd);
+	fds[FD_CGROUP].fd = -1;
+	if (!*path)
+		return;
+	if ((fds[FD_CGROUP].fd = open_trigger(path)) < 0)
+		pprintf(1, "Can't watch %s: %s\n", path, strerror(errno));
+	else
+		pprintf(2, "Watching %s\n", path);
+}
+
+static void event(void) {
+	long long now = monotonic_ns();
+	long long last = __atomic_exchange_n(&pending_ns, now, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&events, 1, __ATOMIC_RELAXED);
+	/* an unmatched event that old was never followed by the CPU load */
+	if (last && now - last >= PSI_MATCH_NS)
+		__atomic_fetch_add(&cpu_missed, 1, __ATOMIC_RELAXED);
+	trigger_wakeup(WAKE_PRESSURE);
+}
+
+static void *psi_watch(void *arg) {
+	sigset_t all;
+	uint64_t val;
+	int i;
+
+	/* signals are for the main loop */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		if (poll(fds, NFDS, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			pprintf(1, "PSI poll failed: %s\n", strerror(errno));
+			break;
+		}
+		if (fds[FD_CONTROL].revents & POLLIN) {
+			if (read(fds[FD_CONTROL].fd, &val, sizeof(val)) < 0)
+				continue;
+			if (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+				reopen_cgroup();
+			continue;
+		}
+		for (i = FD_SYSTEM; i < NFDS; i++) {
+			if (fds[i].fd < 0)
+				continue;
+			if (fds[i].revents & POLLERR) {
+				/* the cgroup went away */
+				close(fds[i].fd);
+				fds[i].fd = -1;
+			} else if (fds[i].revents & POLLPRI) {
+				event();
+			}
+		}
+	}
+	return NULL;
+}
+
+int psi_start(void) {
+	char path[PATH_MAX];
+	int err, i;
+
+	if (!psi_stall_ms || running)
+		return 0;
+
+	for (i = 0; i < NFDS; i++) {
+		fds[i].fd = -1;
+		fds[i].events = i == FD_CONTROL ? POLLIN : POLLPRI;
+	}
+	snprintf(path, sizeof(path), "%s/pressure/cpu", procfs_root);
+	if ((fds[FD_SYSTEM].fd = open_trigger(path)) < 0) {
+		err = errno;
+		pprintf(1, "Can't watch %s: %s\n", path, strerror(err));
+		return err;
+	}
+	if ((fds[FD_CONTROL].fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+		err = errno;
+		close(fds[FD_SYSTEM].fd);
+		return err;
+	}
+	stopping = 0;
+	if ((err = pthread_create(&psi_thread, NULL, psi_watch, NULL)) != 0) {
+		close(fds[FD_CONTROL].fd);
+		close(fds[FD_SYSTEM].fd);
+		return err;
+	}
+	running = 1;
+	pprintf(2, "Waking on %u ms of CPU pressure per %u ms\n",
+			psi_stall_ms * (window_ms / PSI_WINDOW_MS), window_ms);
+	return 0;
+}
+
+void psi_stop(void) {
+	uint64_t one = 1;
+	int i;
+
+	if (!running)
+		return;
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	if (write(fds[FD_CONTROL].fd, &one, sizeof(one)) < 0)
+		pthread_cancel(psi_thread);
+	pthread_join(psi_thread, NULL);
+	for (i = 0; i < NFDS; i++)
+		if (fds[i].fd >= 0)
+			close(fds[i].fd);
+	running = 0;
+}
+
+void psi_watch_pid(int pid) {
+	char dir[PATH_MAX / 2];
+	uint64_t one = 1;
+
+	if (!running)
+		return;
+
+	pthread_mutex_lock(&watch_lock);
+	watch_path[0] = '\0';
+	/* the root cgroup is what /proc/pressure/cpu already covers */
+	if (pid && cgroup_dir_of(pid, dir, sizeof(dir)) == 0
+			&& strcmp(dir, cgroup_root()) != 0)
+		snprintf(watch_path, sizeof(watch_path), "%s/cpu.pressure", dir);
+	pthread_mutex_unlock(&watch_lock);
+	if (write(fds[FD_CONTROL].fd, &one, sizeof(one)) < 0)
+		pprintf(1, "Can't signal the PSI thread: %s\n", strerror(errno));
+}
+
+void psi_reacted(double ms) {
+	reacted++;
+	reaction_sum_ms += ms;
+	if (ms > reaction_max_ms)
+		reaction_max_ms = ms;
+}
+
+void psi_cpu_bound(long long ns) {
+	long long ev = __atomic_exchange_n(&pending_ns, 0, __ATOMIC_RELAXED);
+
+	if (!ev)
+		return;
+	if (ns - ev < PSI_MATCH_NS) {
+		cpu_followed++;
+		lead_sum_ms += (ns - ev) / 1e6;
+	} else {
+		__atomic_fetch_add(&cpu_missed, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void psi_report(int level) {
+	char reaction[80] = "";
+
+	if (!psi_stall_ms)
+		return;
+
+	if (reacted)
+		snprintf(reaction, sizeof(reaction),
+				", reaction %.2f ms average, %.2f ms max",
+				reaction_sum_ms / reacted, reaction_max_ms);
+	pprintf(level, "  %u CPU pressure events%s\n", events, reaction);
+	/* only the CPU load path (-P) matches them */
+	if (cpu_followed || cpu_missed)
+		pprintf(level, "  the CPU load followed %u of them %.0f ms later on "
+				"average, %u never\n", cpu_followed,
+				cpu_followed ? lead_sum_ms / cpu_followed : 0.0, cpu_missed);
+}
@@ -0,0 +1,56 @@
+/*
+ * CPU pressure stall (PSI) triggers as a wake source
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef PSI_H
+#define PSI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PSI_WINDOW_MS 500 /* the shortest window the kernel takes */
+
+extern unsigned int psi_stall_ms; /* per PSI_WINDOW_MS, 0 - off */
+
+/**
+ * Register a trigger on /proc/pressure/cpu and start the thread waking
+ * the main loop with WAKE_PRESSURE when it fires.
+ * @return 0 or errno
+ */
+extern int psi_start(void);
+
+extern void psi_stop(void);
+
+/**
+ * Also watch the cpu.pressure of the process's cgroup, 0 - stop that.
+ */
+extern void psi_watch_pid(int pid);
+
+/* the main loop reacted to a WAKE_PRESSURE after ms */
+extern void psi_reacted(double ms);
+
+/* the CPU load path found a cpu over its upper limit at ns */
+extern void psi_cpu_bound(long long ns);
+
+extern void psi_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PSI_H */
@@ -0,0 +1,169 @@
+/*
+ * Realtime scheduling and memory locking of the governor thread
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "globals.h"
+#include "rtsched.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+
+/* SCHED_DEADLINE reservation: plenty for one tick, in nsecs */
+#define RT_DL_RUNTIME   (1 * 1000 * 1000)
+#define RT_DL_PERIOD    (10 * 1000 * 1000)
+
+/* how much stack the tick path may touch */
+#define RT_STACK_PREFAULT (256 * 1024)
+
+/* glibc has no wrapper for sched_setattr */
+struct rt_sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t  sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+int rt_mode = RT_OFF;
+int rt_priority = 0; /* 0 - the lowest SCHED_FIFO priority */
+
+static unsigned int late_count = 0;
+static double late_sum_ms = 0;
+static double late_max_ms = 0;
+
+static void prefault_stack(void) {
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += sysconf(_SC_PAGESIZE))
+		stack[i] = 0;
+}
+
+static int set_fifo(int prio) {
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	/* the threads JACK starts for us must not inherit it */
+	if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+		return errno;
+	return 0;
+}
+
+static int set_deadline(void) {
+	struct rt_sched_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	/* a deadline task can't create threads otherwise */
+	attr.sched_flags = SCHED_FLAG_RESET_ON_FORK;
+	attr.sched_runtime = RT_DL_RUNTIME;
+	attr.sched_deadline = RT_DL_PERIOD;
+	attr.sched_period = RT_DL_PERIOD;
+	if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0)
+		return errno;
+	return 0;
+}
+
+int rt_init(void) {
+	int err = 0;
+
+	if (rt_mode == RT_OFF) {
+		/* so we don't interfere with anything, including ourself */
+		nice(5);
+		return 0;
+	}
+
+	/* no page faults and no trips to the kernel for memory on the tick path */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		pprintf(1, "Can't lock memory: %s\n", strerror(errno));
+	prefault_stack();
+
+	if (rt_mode == RT_FIFO) {
+		if (!rt_priority)
+			rt_priority = sched_get_priority_min(SCHED_FIFO);
+		err = set_fifo(rt_priority);
+		if (!err)
+			pprintf(2, "Running SCHED_FIFO at priority %d\n", rt_priority);
+	} else {
+		err = set_deadline();
+		if (!err)
+			pprintf(2, "Running SCHED_DEADLINE, %d us every %d us\n",
+			    RT_DL_RUNTIME / 1000, RT_DL_PERIOD / 1000);
+	}
+
+	if (err) {
+		pprintf(0, "Can't switch to realtime scheduling: %s\n", strerror(err));
+		rt_mode = RT_OFF;
+		nice(5);
+	}
+	return err;
+}
+
+void rt_below_jack(int jack_priority) {
+	if (rt_mode != RT_FIFO || jack_priority <= 0 || rt_priority < jack_priority)
+		return;
+
+	rt_priority = jack_priority - 1;
+	if (rt_priority < sched_get_priority_min(SCHED_FIFO))
+		rt_priority = sched_get_priority_min(SCHED_FIFO);
+	pprintf(1, "Lowering SCHED_FIFO priority to %d, below JACK's %d\n",
+	    rt_priority, jack_priority);
+	set_fifo(rt_priority);
+}
+
+void rt_wakeup_late(long long late_ns) {
+	double ms = late_ns > 0 ? late_ns / 1e6 : 0;
+
+	late_count++;
+	late_sum_ms += ms;
+	if (ms > late_max_ms)
+		late_max_ms = ms;
+}
+
+void rt_report(int level) {
+	static const char *const names[] = {"nice", "fifo", "deadline"};
+
+	if (!late_count)
+		return;
+	pprintf(level, "  timed wakeups (%s): %.3f ms late on average, %.3f ms max\n",
+	    names[rt_mode], late_sum_ms / late_count, late_max_ms);
+}
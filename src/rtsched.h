@@ -0,0 +1,58 @@
+/*
+ * Realtime scheduling and memory locking of the governor thread
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef RTSCHED_H
+#define RTSCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum rt_modes {
+	RT_OFF,         /* nice(5), stay out of the way */
+	RT_FIFO,        /* SCHED_FIFO below the JACK threads */
+	RT_DEADLINE     /* SCHED_DEADLINE with a small runtime budget */
+};
+
+extern int rt_mode;
+extern int rt_priority;
+
+/**
+ * Lock all memory, stop malloc from returning memory to the system,
+ * prefault the stack and switch the calling thread to the rt_mode
+ * scheduling class. Falls back to nice(5) on RT_OFF or on failure.
+ * @return 0 or errno
+ */
+extern int rt_init(void);
+
+/**
+ * Make sure a SCHED_FIFO governor stays below the JACK RT threads.
+ * @param jack_priority the RT priority of the JACK clients, <= 0 if unknown
+ */
+extern void rt_below_jack(int jack_priority);
+
+/* record how late a timed wakeup came, in nanoseconds */
+extern void rt_wakeup_late(long long late_ns);
+
+extern void rt_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTSCHED_H */
@@ -0,0 +1,169 @@
+/*
+ * Cooperating with the kernel governor through the scaling limits
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "energy.h"
+#include "scaling_limits.h"
+
+#define LIMITS_EPOCH_NS (60 * 1000000000LL) /* of --actuator compare */
+
+int actuator = ACTUATE_SETSPEED;
+
+static int active = -1;
+static unsigned int switch_count = 0;
+static energy_acct_t accts[ACTUATE_COMPARE];
+static unsigned int xrun_counts[ACTUATE_COMPARE];
+
+static const char *const acct_names[ACTUATE_COMPARE] = {
+	"with scaling_setspeed", "with the floor", "with floor and ceiling"
+};
+
+int limits_active(void) {
+	if (active < 0)
+		active = actuator == ACTUATE_COMPARE ? ACTUATE_SETSPEED : actuator;
+	return active;
+}
+
+static int read_limit(policy_t *pol, const char *file, unsigned long *val) {
+	char path[100], str[32];
+
+	snprintf(path, sizeof(path), "%s%s", pol->sysfs_dir, file);
+	if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+		return -1;
+	*val = strtoul(str, NULL, 10);
+	return 0;
+}
+
+/* val in the units of the driver */
+static int write_limit(policy_t *pol, const char *file, unsigned long val) {
+	char path[100], str[32];
+	int err;
+
+	snprintf(path, sizeof(path), "%s%s", pol->sysfs_dir, file);
+	snprintf(str, sizeof(str), "%lu\n", val);
+	if ((err = write_file(path, str)) != 0)
+		pprintf(1, "Couldn't write %s: %s\n", path, strerror(err));
+	return err;
+}
+
+static unsigned long driver_units(const policy_t *pol, unsigned long khz) {
+	return pol->in_mhz ? khz / 1000 : khz;
+}
+
+/*
+ * The limits are kept per cpu as first read: a policy rebuilt after a
+ * hotplug would read back the floor we wrote ourselves.
+ */
+void limits_save(policy_t *pol) {
+	unsigned long cur;
+	int j;
+
+	pol->saved_max = 0;
+	pol->limit_floor = 0;
+	for (j = 0; j < pol->ncpus; j++) {
+		cpuinfo_t *cpu = all_cpus[pol->cpus[j]];
+
+		if (cpu->saved_max) {
+			pol->saved_min = cpu->saved_min;
+			pol->saved_max = cpu->saved_max;
+			/* the floor in place now, for ordering the next writes */
+			if (read_limit(pol, "scaling_min_freq", &cur) == 0)
+				pol->limit_floor = cur;
+			break;
+		}
+	}
+	if (!pol->saved_max) {
+		if (read_limit(pol, "scaling_min_freq", &pol->saved_min) != 0)
+			pol->saved_min = driver_units(pol, pol->min_speed);
+		if (read_limit(pol, "scaling_max_freq", &pol->saved_max) != 0)
+			pol->saved_max = driver_units(pol, pol->max_speed);
+	}
+	for (j = 0; j < pol->ncpus; j++) {
+		all_cpus[pol->cpus[j]]->saved_min = pol->saved_min;
+		all_cpus[pol->cpus[j]]->saved_max = pol->saved_max;
+	}
+}
+
+int limits_set(policy_t *pol) {
+	unsigned long floor, ceiling = pol->saved_max;
+	int top, err;
+
+	floor = driver_units(pol, pol->freq_table[pol->speed_index]);
+	if (limits_active() == ACTUATE_RANGE) {
+		top = pol->speed_index - RANGE_HEADROOM_STEPS;
+		ceiling = driver_units(pol, pol->freq_table[top > 0 ? top : 0]);
+	}
+
+	/* older kernels refuse a floor above the ceiling and vice versa */
+	if (floor > pol->limit_floor) {
+		if ((err = write_limit(pol, "scaling_max_freq", ceiling)) == 0)
+			err = write_limit(pol, "scaling_min_freq", floor);
+	} else {
+		if ((err = write_limit(pol, "scaling_min_freq", floor)) == 0)
+			err = write_limit(pol, "scaling_max_freq", ceiling);
+	}
+	if (!err)
+		pol->limit_floor = floor;
+	return err;
+}
+
+void limits_restore(policy_t *pol) {
+	if (!pol->saved_max)
+		return;
+	write_limit(pol, "scaling_max_freq", pol->saved_max);
+	write_limit(pol, "scaling_min_freq", pol->saved_min);
+	pol->limit_floor = 0;
+}
+
+int limits_update(unsigned int xruns, long long now) {
+	int want;
+
+	/* the energy of the past tick belongs to the actuator it ran with */
+	energy_account(&accts[limits_active()]);
+	xrun_counts[active] += xruns;
+
+	if (actuator != ACTUATE_COMPARE)
+		return 0;
+	want = (now / LIMITS_EPOCH_NS) % 2 ? ACTUATE_FLOOR : ACTUATE_SETSPEED;
+	if (want == active)
+		return 0;
+	active = want;
+	switch_count++;
+	return 1;
+}
+
+void limits_report(int level) {
+	int i;
+
+	if (actuator == ACTUATE_SETSPEED)
+		return;
+
+	if (actuator == ACTUATE_COMPARE)
+		pprintf(level, "  actuator switched %u times\n", switch_count);
+	for (i = 0; i < ACTUATE_COMPARE; i++) {
+		if (accts[i].seconds <= 0)
+			continue;
+		energy_report(level, acct_names[i], &accts[i]);
+		pprintf(level, "    %u xruns, %.2f per hour\n", xrun_counts[i],
+				xrun_counts[i] * 3600 / accts[i].seconds);
+	}
+}
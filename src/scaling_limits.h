@@ -0,0 +1,68 @@
+/*
+ * Cooperating with the kernel governor through the scaling limits
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef SCALING_LIMITS_H
+#define SCALING_LIMITS_H
+
+#include "cpufreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum actuators {
+	ACTUATE_SETSPEED, /* the userspace governor and scaling_setspeed */
+	ACTUATE_FLOOR,    /* the kernel governor above scaling_min_freq */
+	ACTUATE_RANGE,    /* the kernel governor between both limits */
+	ACTUATE_COMPARE   /* alternate setspeed and floor epochs */
+};
+
+/* the ceiling of ACTUATE_RANGE, in table entries above the floor */
+#define RANGE_HEADROOM_STEPS 2
+
+extern int actuator;
+
+/* the actuator in use now, never ACTUATE_COMPARE */
+extern int limits_active(void);
+
+/* remember the scaling limits of a policy to give them back later */
+extern void limits_save(policy_t *pol);
+
+/**
+ * Move the limits of a policy to its speed_index: the floor there and,
+ * with ACTUATE_RANGE, the ceiling a few steps above.
+ * @return 0 or errno
+ */
+extern int limits_set(policy_t *pol);
+
+/* give a policy its saved limits back */
+extern void limits_restore(policy_t *pol);
+
+/**
+ * Account the last tick's energy and xruns to the actuator in use.
+ * @return 1 when --actuator compare switches the actuator
+ */
+extern int limits_update(unsigned int xruns, long long now);
+
+extern void limits_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCALING_LIMITS_H */
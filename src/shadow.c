@@ -0,0 +1,271 @@
+/*
+ * Shadow mode: governing decisions recorded, not carried out
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "power_model.h"
+#include "scaling_limits.h"
+#include "shadow.h"
+
+/* USER_HZ, the unit of cpufreq/stats/time_in_state */
+#define STATS_HZ 100.0
+
+struct shadow_policy {
+	double *would_seconds;  /* per table entry, where we would have run */
+	double *kernel_seconds; /* per table entry, scaling_cur_freq sampled */
+	unsigned long long *stats_base; /* time_in_state at the start */
+	int have_stats;
+	double would_joules;
+	double kernel_joules;
+};
+
+const char *power_model_file = NULL;
+
+static power_model_t model;
+static int ncpus_conf = 0;
+static unsigned long long *last_busy = NULL, *last_total = NULL;
+static double *cpu_util = NULL;
+static double seconds_total = 0;
+static double retired_would_joules = 0;
+static double retired_kernel_joules = 0;
+
+static int read_time_in_state(policy_t *pol, unsigned long long *ticks) {
+	char path[100], line[64];
+	unsigned long khz;
+	unsigned long long t;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%sstats/time_in_state", pol->sysfs_dir);
+	if ((f = fopen(path, "r")) == NULL)
+		return errno;
+	memset(ticks, 0, pol->table_size * sizeof(*ticks));
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "%lu %llu", &khz, &t) == 2)
+			ticks[nearest_speed_index(pol, pol->in_mhz ? khz * 1000 : khz)] += t;
+	fclose(f);
+	return 0;
+}
+
+/* the busy share of every cpu since the last call, from /proc/stat */
+static void read_cpu_util(void) {
+	unsigned long long user, nice, sys, idle, iowait, irq, softirq, busy, total;
+	char line[256];
+	int cpu;
+	FILE *f;
+
+	if ((f = fopen("/proc/stat", "r")) == NULL)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu", &cpu,
+				&user, &nice, &sys, &idle, &iowait, &irq, &softirq) != 8
+				|| cpu < 0 || cpu >= ncpus_conf)
+			continue;
+		busy = user + nice + sys + irq + softirq;
+		total = busy + idle + iowait;
+		if (last_total[cpu] && total > last_total[cpu])
+			cpu_util[cpu] = (double)(busy - last_busy[cpu])
+				/ (total - last_total[cpu]);
+		last_busy[cpu] = busy;
+		last_total[cpu] = total;
+	}
+	fclose(f);
+}
+
+int shadow_init(void) {
+	unsigned long min_khz = 0, max_khz = 0;
+	int i, err;
+
+	ncpus_conf = sysconf(_SC_NPROCESSORS_CONF);
+	if (ncpus_conf < 1)
+		ncpus_conf = 1;
+	last_busy = (unsigned long long *)calloc(ncpus_conf, sizeof(*last_busy));
+	last_total = (unsigned long long *)calloc(ncpus_conf, sizeof(*last_total));
+	cpu_util = (double *)calloc(ncpus_conf, sizeof(*cpu_util));
+	if (last_busy == NULL || last_total == NULL || cpu_util == NULL) {
+		perror("Couldn't allocate the shadow records");
+		return ENOMEM;
+	}
+	read_cpu_util();
+
+	if (power_model_file) {
+		if ((err = power_model_load(power_model_file, &model)) != 0)
+			pprintf(0, "Can't read power model %s: %s\n",
+					power_model_file, strerror(err));
+		return err;
+	}
+	for (i = 0; i < npolicies; i++) {
+		if (!min_khz || policies[i]->min_speed < min_khz)
+			min_khz = policies[i]->min_speed;
+		if (policies[i]->max_speed > max_khz)
+			max_khz = policies[i]->max_speed;
+	}
+	power_model_default(&model, min_khz, max_khz > min_khz ? max_khz : min_khz + 1);
+	return 0;
+}
+
+int shadow_start(policy_t *pol) {
+	struct shadow_policy *s;
+
+	if ((s = (struct shadow_policy *)calloc(1, sizeof(*s))) == NULL
+			|| (s->would_seconds = (double *)calloc(pol->table_size,
+					sizeof(double))) == NULL
+			|| (s->kernel_seconds = (double *)calloc(pol->table_size,
+					sizeof(double))) == NULL
+			|| (s->stats_base = (unsigned long long *)calloc(pol->table_size,
+					sizeof(unsigned long long))) == NULL) {
+		perror("Couldn't allocate the shadow records");
+		if (s) {
+			free(s->would_seconds);
+			free(s->kernel_seconds);
+		}
+		free(s);
+		return ENOMEM;
+	}
+	s->have_stats = read_time_in_state(pol, s->stats_base) == 0;
+	pol->shadow = s;
+	return 0;
+}
+
+void shadow_stop(policy_t *pol) {
+	struct shadow_policy *s = pol->shadow;
+
+	if (s == NULL)
+		return;
+	retired_would_joules += s->would_joules;
+	retired_kernel_joules += s->kernel_joules;
+	free(s->would_seconds);
+	free(s->kernel_seconds);
+	free(s->stats_base);
+	free(s);
+	pol->shadow = NULL;
+}
+
+/* the entry the policy would run at, given where the kernel runs it */
+static int would_index(const policy_t *pol, int actual, int kernel_governs) {
+	int top;
+
+	if (kernel_governs)
+		return actual;
+	if (pol->is_pstate) {
+		if (pol->current_pstate_mode == SAME)
+			return actual;
+		return pol->current_pstate_mode == RAISE ? 0 : pol->table_size - 1;
+	}
+	switch (limits_active()) {
+		case ACTUATE_FLOOR:
+			return actual < (int)pol->speed_index ? actual : (int)pol->speed_index;
+		case ACTUATE_RANGE:
+			top = pol->speed_index - RANGE_HEADROOM_STEPS;
+			if (top < 0)
+				top = 0;
+			if (actual > (int)pol->speed_index)
+				return pol->speed_index;
+			return actual < top ? top : actual;
+		default:
+			return pol->speed_index;
+	}
+}
+
+void shadow_tick(double seconds, int kernel_governs) {
+	int i, j, actual, would;
+
+	if (seconds <= 0)
+		return;
+	read_cpu_util();
+	seconds_total += seconds;
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+		struct shadow_policy *s = pol->shadow;
+		unsigned long cur, actual_khz, would_khz;
+		double util = 0, share, would_util;
+
+		if (s == NULL)
+			continue;
+		cur = read_cur_speed(pol);
+		actual = cur ? nearest_speed_index(pol, pol->in_mhz ? cur * 1000 : cur)
+			: (int)pol->speed_index;
+		would = would_index(pol, actual, kernel_governs);
+		s->kernel_seconds[actual] += seconds;
+		s->would_seconds[would] += seconds;
+
+		for (j = 0; j < pol->ncpus; j++)
+			util += cpu_util[pol->cpus[j]];
+		util /= pol->ncpus;
+		/* the same work takes longer at a lower speed */
+		actual_khz = pol->freq_table[actual];
+		would_khz = pol->freq_table[would];
+		would_util = util * actual_khz / would_khz;
+		if (would_util > 1)
+			would_util = 1;
+		/* the model is of a package, the policy gets its cpus' share */
+		share = (double)pol->ncpus / ncpus_conf;
+		s->kernel_joules += share * seconds
+			* power_model_watts(&model, actual_khz, util);
+		s->would_joules += share * seconds
+			* power_model_watts(&model, would_khz, would_util);
+	}
+}
+
+static void report_policy(int level, policy_t *pol) {
+	struct shadow_policy *s = pol->shadow;
+	unsigned long long *now = NULL;
+	double kernel;
+	int j, stats;
+
+	now = (unsigned long long *)calloc(pol->table_size, sizeof(*now));
+	stats = s->have_stats && now && read_time_in_state(pol, now) == 0;
+
+	pprintf(level, "  policy%d, would run / kernel ran (%s):\n", pol->id,
+			stats ? "cpufreq/stats" : "sampled");
+	for (j = 0; j < pol->table_size; j++) {
+		kernel = stats ? (now[j] - s->stats_base[j]) / STATS_HZ
+			: s->kernel_seconds[j];
+		if (s->would_seconds[j] < 0.5 && kernel < 0.5)
+			continue;
+		pprintf(level, "    %5luMhz: %8.0f s %8.0f s\n",
+				pol->freq_table[j] / 1000, s->would_seconds[j], kernel);
+	}
+	free(now);
+}
+
+void shadow_report(int level) {
+	double would = retired_would_joules, kernel = retired_kernel_joules;
+	int i;
+
+	if (!shadow)
+		return;
+
+	pprintf(level, "Shadow mode, %.0f seconds recorded:\n", seconds_total);
+	for (i = 0; i < npolicies; i++) {
+		if (policies[i]->shadow == NULL)
+			continue;
+		report_policy(level, policies[i]);
+		would += policies[i]->shadow->would_joules;
+		kernel += policies[i]->shadow->kernel_joules;
+	}
+	if (kernel > 0)
+		pprintf(level, "  modelled energy: %.0f J governed, %.0f J by the "
+				"kernel governor (%+.1f%%)\n", would, kernel,
+				(would - kernel) * 100 / kernel);
+}
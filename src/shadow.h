@@ -0,0 +1,61 @@
+/*
+ * Shadow mode: governing decisions recorded, not carried out
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "cpufreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a power model file as read by jackfreqd-tune, NULL - the generic one */
+extern const char *power_model_file;
+
+/**
+ * Set up the power model for the policies found.
+ * @return 0 or errno
+ */
+extern int shadow_init(void);
+
+/**
+ * Start recording a policy: where it would run and where the kernel
+ * governor really runs it, from cpufreq/stats if there are any.
+ * @return 0 or errno
+ */
+extern int shadow_start(policy_t *pol);
+
+/* stop recording a policy, its energy stays in the totals */
+extern void shadow_stop(policy_t *pol);
+
+/**
+ * Account the last tick to the speed each policy would have run at and
+ * to the one the kernel ran it at.
+ * @param kernel_governs the kernel would have governed, as when handed
+ *   back for an idle session
+ */
+extern void shadow_tick(double seconds, int kernel_governs);
+
+extern void shadow_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADOW_H */
@@ -0,0 +1,244 @@
+/*
+ * Warm start: the learned per-machine state kept across restarts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "cpufreq.h"
+#include "state.h"
+
+#define STATE_VERSION 2
+#define STATE_LINE 8192
+
+int state_enabled = 1;
+
+/* the cpufreq driver of the first policy, all policies share it */
+static void read_driver(char *driver, size_t size) {
+	char path[100];
+
+	snprintf(path, sizeof(path), "%sscaling_driver", policies[0]->sysfs_dir);
+	if (read_file_to(path, 0, 1, driver, size) != 0)
+		snprintf(driver, size, "unknown");
+	driver[strcspn(driver, "\n")] = '\0';
+}
+
+static void print_cpus(FILE *f, const policy_t *pol) {
+	int j;
+
+	for (j = 0; j < pol->ncpus; j++)
+		fprintf(f, "%s%d", j ? "," : "", pol->cpus[j]);
+}
+
+int state_save(int ncpus) {
+	char driver[64], tmp[sizeof(STATE_FILE) + 4];
+	FILE *f;
+	int i, j, err = 0;
+
+	if (!state_enabled || !npolicies)
+		return 0;
+
+	if (mkdir(STATE_DIR, 0755) != 0 && errno != EEXIST)
+		return errno;
+	snprintf(tmp, sizeof(tmp), "%s.new", STATE_FILE);
+	if ((f = fopen(tmp, "w")) == NULL)
+		return errno;
+
+	read_driver(driver, sizeof(driver));
+	fprintf(f, "jackfreqd-state %d\n", STATE_VERSION);
+	fprintf(f, "driver %s\ncpus %d\npolicies %d\n", driver, ncpus, npolicies);
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		/* the probed limits: pruning moves min_speed and max_speed */
+		fprintf(f, "policy %u %lu %lu ", pol->id,
+		    (unsigned long)pol->cpuinfo_min, (unsigned long)pol->cpuinfo_max);
+		print_cpus(f, pol);
+		fprintf(f, "\nfreqs");
+		for (j = 0; j < pol->table_size; j++)
+			fprintf(f, " %lu", pol->freq_table[j]);
+		fprintf(f, "\nmodel %.1f %u", pol->model_work, pol->model_samples);
+		for (j = 0; j < pol->table_size; j++)
+			fprintf(f, " %.4f", pol->model_residual[j]);
+		fprintf(f, "\nglitch %u %u %d\n", pol->transitions,
+		    pol->glitchy_transitions, pol->transition_unsafe);
+	}
+	fprintf(f, "end\n");
+
+	if (ferror(f))
+		err = EIO;
+	if (fclose(f) != 0 && !err)
+		err = errno;
+	if (!err && rename(tmp, STATE_FILE) != 0)
+		err = errno;
+	if (err)
+		unlink(tmp);
+	return err;
+}
+
+static int find_speed(const policy_t *pol, unsigned long speed) {
+	int j;
+
+	for (j = 0; j < pol->table_size; j++)
+		if (pol->freq_table[j] == speed)
+			return j;
+	return -1;
+}
+
+/*
+ * Apply one policy's saved lines: the frequencies it had pruned, its
+ * model and its glitch statistics.
+ */
+static int restore_policy(policy_t *pol, char *freqs, char *model, char *glitch) {
+	unsigned long saved[256];
+	float residual[256];
+	char *tok, *save;
+	int n = 0, j, k;
+
+	strtok_r(freqs, " \n", &save);
+	while ((tok = strtok_r(NULL, " \n", &save)) && n < 256)
+		saved[n++] = strtoul(tok, NULL, 10);
+	/* an empty table would leave nothing to run at */
+	if (!n)
+		return 0;
+	/* a frequency we don't have now: the table changed, start cold */
+	for (k = 0; k < n; k++)
+		if (find_speed(pol, saved[k]) < 0)
+			return 0;
+
+	strtok_r(model, " \n", &save);
+	if (!(tok = strtok_r(NULL, " \n", &save)))
+		return 0;
+	pol->model_work = strtod(tok, NULL);
+	if (!(tok = strtok_r(NULL, " \n", &save)))
+		return 0;
+	pol->model_samples = strtoul(tok, NULL, 10);
+	for (k = 0; k < n && (tok = strtok_r(NULL, " \n", &save)); k++)
+		residual[k] = strtof(tok, NULL);
+	if (k < n)
+		pol->model_samples = 0;
+
+	for (j = pol->table_size - 1; j >= 0; j--) {
+		for (k = 0; k < n; k++)
+			if (saved[k] == pol->freq_table[j])
+				break;
+		if (k == n)
+			remove_speed(pol, j);
+	}
+	sync_policy_speed(pol);
+	for (k = 0; k < n && pol->model_samples; k++)
+		pol->model_residual[k] = residual[k];
+
+	sscanf(glitch, "glitch %u %u %d", &pol->transitions,
+	    &pol->glitchy_transitions, &pol->transition_unsafe);
+	return 1;
+}
+
+/* the saved lines of one policy */
+typedef struct saved_policy {
+	char head[STATE_LINE];
+	char freqs[STATE_LINE];
+	char model[STATE_LINE];
+	char glitch[STATE_LINE];
+} saved_policy_t;
+
+static int same_policy(const policy_t *pol, const char *head) {
+	char cpus[STATE_LINE], now[STATE_LINE];
+	unsigned long min, max;
+	unsigned int id;
+	FILE *m;
+
+	if (sscanf(head, "policy %u %lu %lu %8191s", &id, &min, &max, cpus) != 4)
+		return 0;
+	if ((m = fmemopen(now, sizeof(now), "w")) == NULL)
+		return 0;
+	print_cpus(m, pol);
+	fclose(m);
+	return id == pol->id && min == pol->cpuinfo_min && max == pol->cpuinfo_max
+	    && !strcmp(cpus, now);
+}
+
+int state_load(int ncpus) {
+	char driver[64], saved_driver[64];
+	saved_policy_t *saved = NULL;
+	int version, saved_ncpus, saved_npolicies, i, restored = 0;
+	FILE *f;
+
+	if (!state_enabled || !npolicies)
+		return 0;
+	if ((f = fopen(STATE_FILE, "r")) == NULL)
+		return 0;
+
+	read_driver(driver, sizeof(driver));
+	if (fscanf(f, "jackfreqd-state %d\n", &version) != 1
+	    || version != STATE_VERSION
+	    || fscanf(f, "driver %63s\ncpus %d\npolicies %d\n", saved_driver,
+	        &saved_ncpus, &saved_npolicies) != 3) {
+		pprintf(1, "Ignoring unreadable " STATE_FILE "\n");
+		goto out;
+	}
+	if (strcmp(driver, saved_driver) || saved_ncpus != ncpus
+	    || saved_npolicies != npolicies)
+		goto changed;
+
+	if ((saved = (saved_policy_t *)calloc(npolicies, sizeof(*saved))) == NULL)
+		goto out;
+	/* the same cpus with the same limits in the same policies, or nothing */
+	for (i = 0; i < npolicies; i++) {
+		saved_policy_t *sp = &saved[i];
+
+		if (!fgets(sp->head, STATE_LINE, f) || !fgets(sp->freqs, STATE_LINE, f)
+		    || !fgets(sp->model, STATE_LINE, f)
+		    || !fgets(sp->glitch, STATE_LINE, f)) {
+			pprintf(1, "Ignoring truncated " STATE_FILE "\n");
+			goto out;
+		}
+		if (!same_policy(policies[i], sp->head))
+			goto changed;
+	}
+
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pol = policies[i];
+
+		if (pol->is_pstate) {
+			sscanf(saved[i].glitch, "glitch %u %u %d", &pol->transitions,
+			    &pol->glitchy_transitions, &pol->transition_unsafe);
+			restored++;
+		} else {
+			restored += restore_policy(pol, saved[i].freqs,
+			    saved[i].model, saved[i].glitch);
+		}
+	}
+	if (restored)
+		pprintf(1, "Restored the learned state of %d polic%s\n",
+		    restored, restored > 1 ? "ies" : "y");
+	goto out;
+
+changed:
+	pprintf(1, "The cpus changed since " STATE_FILE " was written, "
+	    "starting cold\n");
+out:
+	free(saved);
+	fclose(f);
+	return restored;
+}
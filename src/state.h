@@ -0,0 +1,51 @@
+/*
+ * Warm start: the learned per-machine state kept across restarts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef STATE_H
+#define STATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATE_DIR "/var/lib/jackfreqd"
+#define STATE_FILE STATE_DIR "/state"
+#define STATE_SAVE_INTERVAL 600 /* seconds */
+
+extern int state_enabled;
+
+/**
+ * Restore the learned state of the policies: pruned frequencies, the
+ * load model and the transition glitch statistics. The whole file is
+ * ignored unless it was written on the same cpu topology and cpufreq
+ * driver, a policy's part if its frequencies changed.
+ * @return the number of policies restored
+ */
+extern int state_load(int ncpus);
+
+/**
+ * Write the learned state, atomically replacing the previous one.
+ * @return 0 or errno
+ */
+extern int state_save(int ncpus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_H */
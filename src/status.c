@@ -0,0 +1,87 @@
+/*
+ * Publishing the status page
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "status.h"
+
+#define STATUS_DIR "/run/jackfreqd"
+
+int status_enabled = 1;
+
+static jfd_status_t *page = NULL;
+
+int status_init(void) {
+	int fd, err = 0;
+
+	if (!status_enabled)
+		return 0;
+
+	if (mkdir(STATUS_DIR, 0755) != 0 && errno != EEXIST)
+		return errno;
+	if ((fd = open(JFD_STATUS_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+		return errno;
+	if (ftruncate(fd, sizeof(jfd_status_t)) != 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+	page = mmap(NULL, sizeof(jfd_status_t), PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		err = errno;
+		page = NULL;
+	}
+	close(fd);
+	if (err)
+		return err;
+
+	page->magic = JFD_STATUS_MAGIC;
+	page->version = JFD_STATUS_VERSION;
+	page->size = sizeof(jfd_status_t);
+	pprintf(2, "Publishing the status at " JFD_STATUS_PATH "\n");
+	return 0;
+}
+
+jfd_status_t *status_begin(void) {
+	if (!page)
+		return NULL;
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return page;
+}
+
+void status_end(void) {
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+void status_close(void) {
+	if (!page)
+		return;
+	munmap(page, sizeof(jfd_status_t));
+	page = NULL;
+	unlink(JFD_STATUS_PATH);
+}
@@ -0,0 +1,50 @@
+/*
+ * Publishing the status page
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "jackfreqd_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int status_enabled;
+
+/**
+ * Create and map the status page.
+ * @return 0 or errno
+ */
+extern int status_init(void);
+
+/**
+ * Start updating the page: readers retry until status_end().
+ * @return the page, NULL if not published
+ */
+extern jfd_status_t *status_begin(void);
+
+extern void status_end(void);
+
+extern void status_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATUS_H */
@@ -0,0 +1,460 @@
+/*
+ * jackfreqd-tune: search the governor thresholds against recorded sessions
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <getopt.h>
+
+#include "globals.h"
+#include "governor.h"
+#include "power_model.h"
+#include "flightrec.h"
+
+#define MAX_THREADS 64
+#define MAX_SESSIONS 64
+
+/* the recorder and logger expect these from the daemon */
+int verbosity = 0;
+int daemonize = 0;
+
+long long monotonic_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+typedef struct sample {
+	double t;           /* seconds */
+	float dsp;          /* DSP load percent */
+	float cpu;          /* CPU load percent, < 0 if not recorded */
+	unsigned long khz;  /* the speed it was measured at, 0 if unknown */
+} sample_t;
+
+typedef struct session {
+	const char *name;
+	sample_t *samples;
+	size_t n;
+} session_t;
+
+typedef struct candidate {
+	governor_params_t gp;
+	unsigned int poll;   /* msecs */
+	unsigned int step;   /* kHz, 0 - the frequencies of the power model */
+	double joules;
+	double overload;     /* seconds above the overload load */
+	double seconds;
+} candidate_t;
+
+static session_t sessions[MAX_SESSIONS];
+static int nsessions = 0;
+static int have_cpu = 0;
+static power_model_t model;
+static float overload_pct = 95;
+
+static candidate_t *candidates = NULL;
+static int ncandidates = 0;
+static int next_candidate = 0;
+
+static const unsigned int grid_poll[] = {100, 250, 500, 1000, 2000};
+static const unsigned int grid_step[] = {0, 50000, 100000, 200000};
+static const unsigned int grid_highwater_cpu[] = {60, 70, 80, 90};
+static const unsigned int grid_lowwater_cpu[] = {10, 20, 30, 40};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+void help(void) {
+	printf("jackfreqd-tune: find governor thresholds for recorded sessions\n");
+	printf("\nUsage: jackfreqd-tune [options] session...\n");
+	printf("\nA session is a flight recorder dump (*.rec) or a text file of\n");
+	printf("'seconds dsp-load [cpu-load [kHz]]' lines, loads in percent.\n");
+	printf("\nAvailable Options:\n");
+	printf(" -h        Print this help message\n");
+	printf(" -m file   Power model: 'kHz idle-watts busy-watts' lines\n");
+	printf("           (default: a generic model from -f and -F)\n");
+	printf(" -f #      Lowest frequency in kHz of the generic model (default = 800000)\n");
+	printf(" -F #      Highest frequency in kHz of the generic model (default = 3600000)\n");
+	printf(" -o #      DSP load percentage counting as overload (default = 95)\n");
+	printf(" -b #      Overload budget in percent of the time (default = 0.1)\n");
+	printf(" -t #      Number of threads (default: all cpus)\n");
+	printf("\n");
+}
+
+static int add_sample(session_t *s, size_t *size, const sample_t *smp) {
+	if (s->n == *size) {
+		sample_t *n;
+
+		*size = *size ? *size * 2 : 1024;
+		if ((n = realloc(s->samples, *size * sizeof(sample_t))) == NULL)
+			return ENOMEM;
+		s->samples = n;
+	}
+	s->samples[s->n++] = *smp;
+	return 0;
+}
+
+static int load_text(const char *file, session_t *s) {
+	char line[200];
+	size_t size = 0;
+	sample_t smp;
+	FILE *f;
+	int err = 0;
+
+	if ((f = fopen(file, "r")) == NULL)
+		return errno;
+	while (!err && fgets(line, sizeof(line), f)) {
+		int fields;
+
+		if (line[0] == '#')
+			continue;
+		smp.cpu = -1;
+		smp.khz = 0;
+		fields = sscanf(line, "%lf %f %f %lu", &smp.t, &smp.dsp,
+				&smp.cpu, &smp.khz);
+		if (fields < 2)
+			continue;
+		if (smp.cpu >= 0)
+			have_cpu = 1;
+		err = add_sample(s, &size, &smp);
+	}
+	fclose(f);
+	return err;
+}
+
+static int load_recording(const char *file, session_t *s) {
+	flightrec_entry_t *ticks;
+	size_t n, i, size = 0;
+	sample_t smp;
+	int err;
+
+	if ((err = flightrec_read(file, &ticks, &n)) != 0)
+		return err;
+	for (i = 0; i < n && !err; i++) {
+		smp.t = (ticks[i].ns - ticks[0].ns) / 1e9;
+		smp.dsp = ticks[i].load;
+		smp.cpu = -1;
+		smp.khz = ticks[i].value;
+		err = add_sample(s, &size, &smp);
+	}
+	free(ticks);
+	return err;
+}
+
+static int load_session(const char *file) {
+	session_t *s = &sessions[nsessions];
+	size_t len = strlen(file);
+	int err;
+
+	s->name = file;
+	if (len > 4 && !strcmp(file + len - 4, ".rec"))
+		err = load_recording(file, s);
+	else
+		err = load_text(file, s);
+	if (err)
+		return err;
+	if (s->n < 2) {
+		fprintf(stderr, "%s: too short, skipped\n", file);
+		free(s->samples);
+		return 0;
+	}
+	nsessions++;
+	return 0;
+}
+
+#define MAX_TABLE_SIZE 1024
+
+/* frequencies highest first, like the daemon's tables */
+static int build_table(unsigned int step, unsigned long *table) {
+	unsigned long min = model.points[0].khz;
+	unsigned long max = model.points[model.npoints - 1].khz;
+	int i, n = 0;
+
+	if (!step) {
+		for (i = model.npoints - 1; i >= 0; i--)
+			table[n++] = model.points[i].khz;
+		return n;
+	}
+	for (i = 0; max >= min + (unsigned long)i * step && n < MAX_TABLE_SIZE; i++)
+		table[n++] = max - (unsigned long)i * step;
+	return n;
+}
+
+/*
+ * Replay a session: the load scales with 1/f from the speed it was
+ * recorded at, the governor looks at it every poll msecs.
+ */
+static void replay(candidate_t *c, const session_t *s,
+		const unsigned long *table, const double *idle_w,
+		const double *busy_w, int table_size) {
+	double t = s->samples[0].t;
+	double next_tick = t;
+	double end = s->samples[s->n - 1].t;
+	size_t k = 0;
+	int index = 0;
+
+	while (t < end) {
+		const sample_t *smp = &s->samples[k];
+		double ref = smp->khz ? smp->khz : table[0];
+		double dsp = smp->dsp * ref / table[index];
+		double cpu = smp->cpu >= 0 ? smp->cpu * ref / table[index] : 0;
+		double until = s->samples[k + 1].t < next_tick
+			? s->samples[k + 1].t : next_tick;
+		double dt = until - t;
+
+		if (dt > 0) {
+			double util = (dsp > cpu ? dsp : cpu) / 100.0;
+
+			if (util > 1)
+				util = 1;
+			c->joules += (idle_w[index]
+					+ util * (busy_w[index] - idle_w[index])) * dt;
+			if (dsp >= overload_pct)
+				c->overload += dt;
+			c->seconds += dt;
+		}
+		t = until;
+
+		if (t >= next_tick) {
+			int raise, lower;
+			enum modes mode;
+
+			governor_dsp_limits(&c->gp, dsp, &raise, &lower);
+			mode = governor_decide(&c->gp, raise, lower, cpu / 100.0,
+					index == 0, index == table_size - 1);
+			index = governor_next_index(mode, index, table_size);
+			next_tick += c->poll / 1000.0;
+		}
+		if (t >= s->samples[k + 1].t)
+			k++;
+	}
+}
+
+static void *search_thread(void *arg) {
+	unsigned long table[MAX_TABLE_SIZE];
+	double idle_w[MAX_TABLE_SIZE], busy_w[MAX_TABLE_SIZE];
+	int i, j, table_size;
+
+	while ((i = __atomic_fetch_add(&next_candidate, 1, __ATOMIC_RELAXED))
+			< ncandidates) {
+		candidate_t *c = &candidates[i];
+
+		table_size = build_table(c->step, table);
+		for (j = 0; j < table_size; j++)
+			power_model_at(&model, table[j], &idle_w[j], &busy_w[j]);
+		for (j = 0; j < nsessions; j++)
+			replay(c, &sessions[j], table, idle_w, busy_w, table_size);
+	}
+	return NULL;
+}
+
+static int build_grid(void) {
+	unsigned int u, l, p, st, cu, cl, cpu_modes;
+	int n = 0, pass;
+
+	/* count, then fill */
+	for (pass = 0; pass < 2; pass++) {
+		for (u = 20; u <= 90; u += 5)
+		for (l = 0; l + 10 <= u; l += 5)
+		for (p = 0; p < ARRAY_SIZE(grid_poll); p++)
+		for (st = 0; st < ARRAY_SIZE(grid_step); st++) {
+			cpu_modes = have_cpu ? 1 + ARRAY_SIZE(grid_highwater_cpu)
+				* ARRAY_SIZE(grid_lowwater_cpu) : 1;
+			for (cu = 0; cu < cpu_modes; cu++) {
+				candidate_t *c;
+
+				cl = cu ? (cu - 1) % ARRAY_SIZE(grid_lowwater_cpu) : 0;
+				if (cu && grid_lowwater_cpu[cl] >= grid_highwater_cpu
+						[(cu - 1) / ARRAY_SIZE(grid_lowwater_cpu)])
+					continue;
+				if (pass) {
+					c = &candidates[n];
+					memset(c, 0, sizeof(*c));
+					c->gp.highwater_dsp = u;
+					c->gp.lowwater_dsp = l;
+					c->gp.use_cpu_load = cu != 0;
+					if (cu) {
+						c->gp.highwater_cpu = grid_highwater_cpu
+							[(cu - 1) / ARRAY_SIZE(grid_lowwater_cpu)];
+						c->gp.lowwater_cpu = grid_lowwater_cpu[cl];
+					}
+					c->poll = grid_poll[p];
+					c->step = grid_step[st];
+				}
+				n++;
+			}
+		}
+		if (!pass) {
+			candidates = (candidate_t *)calloc(n, sizeof(candidate_t));
+			if (candidates == NULL)
+				return ENOMEM;
+			ncandidates = n;
+			n = 0;
+		}
+	}
+	return 0;
+}
+
+static int compare_energy(const void *a, const void *b) {
+	const candidate_t *ca = a, *cb = b;
+
+	if (ca->joules != cb->joules)
+		return ca->joules < cb->joules ? -1 : 1;
+	return (ca->overload > cb->overload) - (ca->overload < cb->overload);
+}
+
+static void print_options(FILE *f, const candidate_t *c) {
+	fprintf(f, "-u %u -l %u -p %u", c->gp.highwater_dsp,
+			c->gp.lowwater_dsp, c->poll);
+	if (c->step)
+		fprintf(f, " -s %u", c->step);
+	if (c->gp.use_cpu_load)
+		fprintf(f, " -P -U %u -L %u", c->gp.highwater_cpu,
+				c->gp.lowwater_cpu);
+}
+
+int main(int argc, char **argv) {
+	pthread_t threads[MAX_THREADS];
+	unsigned long min_khz = 800000, max_khz = 3600000;
+	const char *model_file = NULL;
+	double budget_pct = 0.1, best_overload;
+	candidate_t *pick = NULL;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	long long start;
+	int c, i, err;
+
+	while ((c = getopt(argc, argv, "m:f:F:o:b:t:h")) != -1) {
+		switch (c) {
+			case 'm':
+				model_file = optarg;
+				break;
+			case 'f':
+				min_khz = strtoul(optarg, NULL, 10);
+				break;
+			case 'F':
+				max_khz = strtoul(optarg, NULL, 10);
+				break;
+			case 'o':
+				overload_pct = strtof(optarg, NULL);
+				break;
+			case 'b':
+				budget_pct = strtod(optarg, NULL);
+				break;
+			case 't':
+				nthreads = strtol(optarg, NULL, 10);
+				break;
+			case 'h':
+				help();
+				exit(0);
+			default:
+				help();
+				exit(ENOTSUP);
+		}
+	}
+	if (optind >= argc) {
+		help();
+		exit(ENOTSUP);
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	if (model_file) {
+		if ((err = power_model_load(model_file, &model)) != 0) {
+			fprintf(stderr, "Can't read power model %s: %s\n",
+					model_file, strerror(err));
+			exit(err);
+		}
+	} else {
+		if (min_khz >= max_khz) {
+			fprintf(stderr, "-f must be below -F\n");
+			exit(ENOTSUP);
+		}
+		power_model_default(&model, min_khz, max_khz);
+	}
+
+	for (i = optind; i < argc && nsessions < MAX_SESSIONS; i++) {
+		if ((err = load_session(argv[i])) != 0) {
+			fprintf(stderr, "Can't read session %s: %s\n",
+					argv[i], strerror(err));
+			exit(err);
+		}
+	}
+	if (!nsessions) {
+		fprintf(stderr, "No usable sessions\n");
+		exit(EINVAL);
+	}
+
+	if ((err = build_grid()) != 0) {
+		fprintf(stderr, "Can't allocate the search grid\n");
+		exit(err);
+	}
+
+	start = monotonic_ns();
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, search_thread, NULL) != 0)
+			break;
+	nthreads = i;
+	search_thread(NULL);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("# %d sessions, %d parameter sets, %d threads, %.2f seconds\n",
+			nsessions, ncandidates, nthreads + 1,
+			(monotonic_ns() - start) / 1e9);
+
+	/* the Pareto front: cheapest first, each with less overload than all cheaper ones */
+	qsort(candidates, ncandidates, sizeof(candidate_t), compare_energy);
+	printf("# energy [J]  average [W]  overload [%% of time]  options\n");
+	best_overload = -1;
+	for (i = 0; i < ncandidates; i++) {
+		candidate_t *cd = &candidates[i];
+		double pct = cd->seconds ? 100.0 * cd->overload / cd->seconds : 0;
+
+		if (best_overload >= 0 && cd->overload >= best_overload)
+			continue;
+		best_overload = cd->overload;
+		printf("%12.1f  %11.2f  %20.3f  ", cd->joules,
+				cd->seconds ? cd->joules / cd->seconds : 0, pct);
+		print_options(stdout, cd);
+		printf("\n");
+		if (!pick && pct <= budget_pct)
+			pick = cd;
+	}
+	/* nothing fits the budget: the least overload there is */
+	if (!pick)
+		for (i = 0; i < ncandidates; i++)
+			if (!pick || candidates[i].overload < pick->overload)
+				pick = &candidates[i];
+
+	printf("\n# for /etc/default/jackfreqd\nOPTIONS=\"-w ");
+	print_options(stdout, pick);
+	printf("\"\n");
+
+	for (i = 0; i < nsessions; i++)
+		free(sessions[i].samples);
+	free(candidates);
+	return 0;
+}
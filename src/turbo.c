@@ -0,0 +1,177 @@
+/*
+ * Turbo (boost) frequencies governed as a state of their own
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "energy.h"
+#include "turbo.h"
+
+#define SYSFS_CPU_TREE "/sys/devices/system/cpu/"
+#define BOOST_KNOB SYSFS_CPU_TREE "cpufreq/boost"
+#define NO_TURBO_KNOB SYSFS_CPU_TREE "intel_pstate/no_turbo"
+
+/*
+ * Turbo goes off again once the load, scaled back to the speed without
+ * turbo, falls below this share of highwater_dsp.
+ */
+#define TURBO_OFF_PCT 80
+#define TURBO_MAX_GAIN 2.0
+
+int turbo_mode = TURBO_AUTO;
+unsigned int turbo_dwell = 5000;
+
+static const char *knob = NULL;
+static int inverted = 0;          /* no_turbo: 1 means off */
+static int initial_on = -1;       /* -1 - not read */
+static int on = -1;               /* what we wrote last, -1 - nothing */
+static long long last_switch_ns = 0;
+static float load_before = 0;     /* the load that asked for turbo */
+static int gain_pending = 0;
+static float gain = 1.0;          /* load without turbo / load with it */
+static unsigned int switch_count = 0;
+
+static energy_acct_t on_acct;
+static energy_acct_t off_acct;
+
+static int read_knob(void) {
+	char str[16];
+
+	if (read_file_to(knob, 0, 1, str, sizeof(str)) != 0)
+		return -1;
+	return (strtol(str, NULL, 10) != 0) != inverted;
+}
+
+static int set_turbo(int want, long long now) {
+	int err;
+
+	if (want == on)
+		return 0;
+	if ((err = write_file(knob, (want != inverted) ? "1" : "0")) != 0) {
+		pprintf(1, "Couldn't write %s: %s, leaving turbo alone\n",
+				knob, strerror(err));
+		knob = NULL;
+		return err;
+	}
+	pprintf(2, "Turbo %s\n", want ? "on" : "off");
+	if (on >= 0)
+		switch_count++;
+	on = want;
+	last_switch_ns = now;
+	return 0;
+}
+
+int turbo_init(void) {
+	if (turbo_mode == TURBO_KEEP)
+		return 0;
+
+	knob = BOOST_KNOB;
+	inverted = 0;
+	if ((initial_on = read_knob()) < 0) {
+		knob = NO_TURBO_KNOB;
+		inverted = 1;
+		initial_on = read_knob();
+	}
+	if (initial_on < 0) {
+		pprintf(2, "Turbo is not controllable\n");
+		knob = NULL;
+		return ENOENT;
+	}
+	pprintf(2, "Turbo through %s, initially %s\n", knob,
+			initial_on ? "on" : "off");
+	return 0;
+}
+
+void turbo_update(float dspload, int at_max, long long now) {
+	int dwelled;
+
+	if (!knob)
+		return;
+
+	/* the energy of the past tick belongs to the state it ran in */
+	if (on >= 0)
+		energy_account(on ? &on_acct : &off_acct);
+
+	if (turbo_mode == TURBO_OFF || on < 0) {
+		set_turbo(0, now);
+		return;
+	}
+
+	dwelled = now - last_switch_ns >= turbo_dwell * 1000000LL;
+	if (!on) {
+		if (at_max && dspload > highwater_dsp && dwelled
+				&& set_turbo(1, now) == 0) {
+			load_before = dspload;
+			gain_pending = 1;
+		}
+		return;
+	}
+
+	/* the first load with turbo tells what it bought */
+	if (gain_pending && dspload > 0) {
+		gain = load_before / dspload;
+		if (gain < 1.0)
+			gain = 1.0;
+		if (gain > TURBO_MAX_GAIN)
+			gain = TURBO_MAX_GAIN;
+		gain_pending = 0;
+		pprintf(3, "Turbo lowered the load by %.0f%%\n", 100.0 - 100.0 / gain);
+	}
+	if (dwelled && dspload * gain * 100 < highwater_dsp * TURBO_OFF_PCT)
+		set_turbo(0, now);
+}
+
+int turbo_managed(void) {
+	return knob != NULL;
+}
+
+void turbo_idle(long long now) {
+	if (knob && turbo_mode != TURBO_KEEP)
+		set_turbo(0, now);
+}
+
+void turbo_release(void) {
+	int err;
+
+	if (!knob || on < 0)
+		return;
+	if (on != initial_on) {
+		pprintf(2, "Restoring turbo %s\n", initial_on ? "on" : "off");
+		if ((err = write_file(knob, (initial_on != inverted) ? "1" : "0")) != 0)
+			pprintf(1, "Couldn't write %s: %s\n", knob, strerror(err));
+	}
+	on = -1;
+}
+
+void turbo_report(int level) {
+	double total = on_acct.seconds + off_acct.seconds;
+
+	if (!knob)
+		return;
+
+	pprintf(level, "  turbo switched %u times, on %.1f%% of the time\n",
+			switch_count, total > 0 ? 100.0 * on_acct.seconds / total : 0.0);
+	energy_report(level, "with turbo", &on_acct);
+	energy_report(level, "without turbo", &off_acct);
+}
@@ -0,0 +1,67 @@
+/*
+ * Turbo (boost) frequencies governed as a state of their own
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef TURBO_H
+#define TURBO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum turbo_modes {
+	TURBO_KEEP,   /* leave the knob as it is */
+	TURBO_OFF,    /* no turbo while audio runs */
+	TURBO_AUTO    /* turbo only for loads the max speed can't sustain */
+};
+
+extern int turbo_mode;
+extern unsigned int turbo_dwell; /* msecs between two switches */
+
+/**
+ * Find the turbo knob, cpufreq/boost or intel_pstate/no_turbo, and
+ * remember its setting.
+ * @return 0 or errno
+ */
+extern int turbo_init(void);
+
+/**
+ * Switch turbo for the last tick's DSP load.
+ * @param at_max all governed policies run at their max speed
+ */
+extern void turbo_update(float dspload, int at_max, long long now);
+
+/*
+ * Whether this module switches the knob. The top table entry of
+ * acpi-cpufreq is turbo then and runs as the max without turbo while
+ * the knob is off.
+ */
+extern int turbo_managed(void);
+
+/* turn turbo off at once, for an idle session */
+extern void turbo_idle(long long now);
+
+/* restore the setting found by turbo_init() */
+extern void turbo_release(void);
+
+extern void turbo_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TURBO_H */
@@ -0,0 +1,215 @@
+/*
+ * Uncore (memory fabric) frequency governed alongside the cores
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <glob.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "energy.h"
+#include "uncore.h"
+
+#define UNCORE_TREE "/sys/devices/system/cpu/intel_uncore_frequency/"
+#define MAX_UNCORE_DOMAINS 16
+#define UNCORE_STEP 100000 /* kHz */
+
+/*
+ * A step down that raises the DSP load by more than this marks the
+ * session memory-bound at that level: the uncore stays above it.
+ */
+#define UNCORE_SENSITIVE_PCT 10
+#define UNCORE_MIN_LOAD 1.0
+#define UNCORE_EPOCH_NS (60 * 1000000000LL) /* of --uncore compare */
+
+typedef struct uncore_domain {
+	char dir[PATH_MAX];
+	unsigned long init_min; /* kHz */
+	unsigned long init_max;
+} uncore_domain_t;
+
+int uncore_mode = UNCORE_OFF;
+
+static uncore_domain_t domains[MAX_UNCORE_DOMAINS];
+static int ndomains = 0;
+static int nlevels = 0;      /* UNCORE_STEP levels down from the max */
+static int cur_level = -1;   /* 0 - max, -1 - initial limits */
+static int floor_level = -1; /* lowest level allowed, -1 - none yet */
+static float step_load = -1; /* the load before the last step down */
+static unsigned int step_count = 0;
+static unsigned int floor_count = 0;
+
+static energy_acct_t governed_acct;
+static energy_acct_t core_only_acct;
+
+static int read_khz(const char *dir, const char *file, unsigned long *khz) {
+	char path[PATH_MAX], str[32];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	if (read_file_to(path, 0, 1, str, sizeof(str)) != 0)
+		return -1;
+	*khz = strtoul(str, NULL, 10);
+	return 0;
+}
+
+static void write_khz(const char *dir, const char *file, unsigned long khz) {
+	char path[PATH_MAX], str[32];
+	int err;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	snprintf(str, sizeof(str), "%lu\n", khz);
+	if ((err = write_file(path, str)) != 0)
+		pprintf(1, "Couldn't write %s: %s\n", path, strerror(err));
+}
+
+/* min and max in the order that keeps min <= max at every moment */
+static void set_limits(uncore_domain_t *d, unsigned long min, unsigned long max) {
+	unsigned long cur_min = 0;
+
+	read_khz(d->dir, "min_freq_khz", &cur_min);
+	if (max >= cur_min) {
+		write_khz(d->dir, "max_freq_khz", max);
+		write_khz(d->dir, "min_freq_khz", min);
+	} else {
+		write_khz(d->dir, "min_freq_khz", min);
+		write_khz(d->dir, "max_freq_khz", max);
+	}
+}
+
+static void set_level(int l) {
+	int i;
+
+	if (l == cur_level)
+		return;
+	for (i = 0; i < ndomains; i++) {
+		uncore_domain_t *d = &domains[i];
+		unsigned long khz = d->init_max - (unsigned long)l * UNCORE_STEP;
+
+		if (khz < d->init_min || khz > d->init_max)
+			khz = d->init_min;
+		set_limits(d, khz, khz);
+		pprintf(3, "uncore %s: %lu MHz\n", d->dir, khz / 1000);
+	}
+	cur_level = l;
+}
+
+int uncore_init(void) {
+	glob_t g;
+	size_t i;
+
+	if (uncore_mode == UNCORE_OFF)
+		return 0;
+
+	/* package_XX_die_YY, or uncoreNN with TPMI */
+	if (glob(UNCORE_TREE "*", GLOB_ONLYDIR, NULL, &g) == 0) {
+		for (i = 0; i < g.gl_pathc && ndomains < MAX_UNCORE_DOMAINS; i++) {
+			uncore_domain_t *d = &domains[ndomains];
+			int n;
+
+			snprintf(d->dir, sizeof(d->dir), "%s", g.gl_pathv[i]);
+			if (read_khz(d->dir, "initial_min_freq_khz", &d->init_min) != 0
+					|| read_khz(d->dir, "initial_max_freq_khz", &d->init_max) != 0
+					|| d->init_max <= d->init_min)
+				continue;
+			n = (d->init_max - d->init_min + UNCORE_STEP - 1) / UNCORE_STEP + 1;
+			if (n > nlevels)
+				nlevels = n;
+			pprintf(3, "  uncore %s: %lu - %lu MHz\n", d->dir,
+					d->init_min / 1000, d->init_max / 1000);
+			ndomains++;
+		}
+		globfree(&g);
+	}
+	if (ndomains)
+		pprintf(2, "Governing %d uncore domain%s\n", ndomains,
+				ndomains > 1 ? "s" : "");
+	else
+		pprintf(2, "Uncore frequency is not controllable\n");
+	return ndomains;
+}
+
+void uncore_release(void) {
+	int i;
+
+	if (cur_level < 0)
+		return;
+	pprintf(3, "Restoring the uncore limits\n");
+	for (i = 0; i < ndomains; i++)
+		set_limits(&domains[i], domains[i].init_min, domains[i].init_max);
+	cur_level = -1;
+	step_load = -1;
+}
+
+void uncore_update(float dspload, long long now) {
+	int l;
+
+	if (!ndomains)
+		return;
+
+	/* the energy of the past tick belongs to the state it ran in */
+	energy_account(cur_level >= 0 ? &governed_acct : &core_only_acct);
+
+	if (uncore_mode == UNCORE_COMPARE && (now / UNCORE_EPOCH_NS) % 2) {
+		uncore_release();
+		return;
+	}
+	if (cur_level < 0) {
+		/* start where the cores start: fast */
+		set_level(0);
+		return;
+	}
+
+	/* did the last step down cost more load than it should? */
+	if (step_load >= UNCORE_MIN_LOAD && dspload * 100
+			> step_load * (100 + UNCORE_SENSITIVE_PCT)) {
+		pprintf(2, "DSP load follows the uncore (%.1f%% -> %.1f%%), "
+				"holding it a step higher\n", step_load, dspload);
+		floor_level = cur_level - 1;
+		floor_count++;
+		set_level(floor_level);
+		step_load = -1;
+		return;
+	}
+	step_load = -1;
+
+	l = cur_level;
+	if (dspload > highwater_dsp)
+		l = 0;
+	else if (dspload < lowwater_dsp && l < nlevels - 1
+			&& (floor_level < 0 || l < floor_level)) {
+		l++;
+		step_load = dspload;
+		step_count++;
+	}
+	set_level(l);
+}
+
+void uncore_report(int level) {
+	if (!ndomains)
+		return;
+
+	pprintf(level, "  uncore stepped down %u times, held up %u times\n",
+			step_count, floor_count);
+	energy_report(level, "with the uncore governed", &governed_acct);
+	if (core_only_acct.seconds > 0)
+		energy_report(level, "with the cores only", &core_only_acct);
+}
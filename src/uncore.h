@@ -0,0 +1,52 @@
+/*
+ * Uncore (memory fabric) frequency governed alongside the cores
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#ifndef UNCORE_H
+#define UNCORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum uncore_modes {
+	UNCORE_OFF,     /* leave the uncore to the hardware */
+	UNCORE_ON,      /* govern it with the DSP load */
+	UNCORE_COMPARE  /* alternate governed and core-only epochs */
+};
+
+extern int uncore_mode;
+
+/**
+ * Find the intel_uncore_frequency domains and remember their limits.
+ * @return the number of domains found
+ */
+extern int uncore_init(void);
+
+/* set the uncore speed for the last tick's DSP load */
+extern void uncore_update(float dspload, long long now);
+
+/* give the domains their initial limits back */
+extern void uncore_release(void);
+
+extern void uncore_report(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UNCORE_H */
@@ -0,0 +1,180 @@
+/*
+ * The ALSA procfs load source against a fake procfs tree
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "alsa_load.h"
+
+#define SUBSTREAM "asound/card0/pcm0p/sub0"
+
+/* what alsa_load.c takes from the daemon */
+int verbosity = 0;
+const char *procfs_root = NULL;
+
+void log_printf(int level, const char *fmt, ...) {
+}
+
+void glitch_record(long long ns) {
+}
+
+long long monotonic_ns(void) {
+	return 0;
+}
+
+int read_file_to(const char *file, int fd, int new, char *dst, size_t size) {
+	ssize_t len;
+
+	if (new && (fd = open(file, O_RDONLY)) < 0)
+		return errno;
+	len = pread(fd, dst, size - 1, 0);
+	if (new)
+		close(fd);
+	if (len < 0)
+		return errno;
+	dst[len] = '\0';
+	return 0;
+}
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static void copy_file(const char *from, const char *to) {
+	char text[4096];
+	size_t len;
+	FILE *in, *out;
+
+	if ((in = fopen(from, "r")) == NULL || (out = fopen(to, "w")) == NULL) {
+		perror(from);
+		exit(1);
+	}
+	len = fread(text, 1, sizeof(text), in);
+	fwrite(text, 1, len, out);
+	fclose(in);
+	fclose(out);
+}
+
+/* rewrite the status in place: the open fd must see the new contents */
+static void write_status(const char *state, const char *trigger,
+		unsigned long avail_max) {
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/" SUBSTREAM "/status", procfs_root);
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(f, "state: %s\nowner_pid   : 4242\ntrigger_time: %s\n"
+			"tstamp      : 9.123456789\ndelay       : 448\n"
+			"avail       : 64\navail_max   : %lu\n-----\n"
+			"hw_ptr      : 429120\nappl_ptr    : 429568\n",
+			state, trigger, avail_max);
+	fclose(f);
+}
+
+int main(int argc, char **argv) {
+	char tmpl[] = "/tmp/alsa_load_test.XXXXXX", dir[PATH_MAX], from[PATH_MAX];
+	const char *parts[] = {"asound", "asound/card0", "asound/card0/pcm0p",
+		SUBSTREAM, NULL};
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <fixture procfs>\n", argv[0]);
+		return 2;
+	}
+	if ((procfs_root = mkdtemp(tmpl)) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	for (i = 0; parts[i]; i++) {
+		snprintf(dir, sizeof(dir), "%s/%s", procfs_root, parts[i]);
+		mkdir(dir, 0755);
+	}
+	snprintf(from, sizeof(from), "%s/" SUBSTREAM "/hw_params", argv[1]);
+	snprintf(dir, sizeof(dir), "%s/" SUBSTREAM "/hw_params", procfs_root);
+	copy_file(from, dir);
+	snprintf(from, sizeof(from), "%s/" SUBSTREAM "/status", argv[1]);
+	snprintf(dir, sizeof(dir), "%s/" SUBSTREAM "/status", procfs_root);
+	copy_file(from, dir);
+
+	CHECK(alsa_open() == 1);
+	CHECK(alsa_owner_pid() == 4242);
+	CHECK(alsa_period_usecs() == 5333);
+
+	/* 256 frames periods in a 512 frames buffer: 384 is half the headroom */
+	CHECK(fabsf(alsa_poll() - 50.0f) < 0.01f);
+	write_status("RUNNING", "5.123456789", 256);
+	CHECK(alsa_poll() == 0.0f);
+	write_status("RUNNING", "5.123456789", 600);
+	CHECK(alsa_poll() == 100.0f);
+	CHECK(alsa_xruns() == 0);
+
+	/* an XRUN state counts once however long it lasts */
+	write_status("XRUN", "5.123456789", 512);
+	alsa_poll();
+	alsa_poll();
+	CHECK(alsa_xruns() == 1);
+
+	/* leaving the XRUN state alone is no new xrun */
+	write_status("RUNNING", "5.123456789", 320);
+	CHECK(fabsf(alsa_poll() - 25.0f) < 0.01f);
+	CHECK(alsa_xruns() == 1);
+
+	/* a new trigger_time is a restart between two reads, counted once */
+	write_status("RUNNING", "7.000000001", 320);
+	alsa_poll();
+	CHECK(alsa_xruns() == 2);
+	alsa_poll();
+	CHECK(alsa_xruns() == 2);
+
+	/* a stopped stream closes the source */
+	write_status("SETUP", "7.000000001", 0);
+	alsa_poll();
+	CHECK(!alsa_is_open());
+
+	unlink(dir);
+	snprintf(dir, sizeof(dir), "%s/" SUBSTREAM "/hw_params", procfs_root);
+	unlink(dir);
+	for (i = 3; i >= 0; i--) {
+		snprintf(dir, sizeof(dir), "%s/%s", procfs_root, parts[i]);
+		rmdir(dir);
+	}
+	rmdir(procfs_root);
+
+	if (failures)
+		fprintf(stderr, "%d checks failed\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * The cgroup v2 load source against a fake cgroupfs and procfs tree
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "cgroup_load.h"
+
+#define AUDIO_TID 100
+
+/* what cgroup_load.c takes from the daemon */
+int verbosity = 0;
+const char *procfs_root = NULL;
+static long long now_ns = 0;
+
+void log_printf(int level, const char *fmt, ...) {
+}
+
+long long monotonic_ns(void) {
+	return now_ns;
+}
+
+int read_file_to(const char *file, int fd, int new, char *dst, size_t size) {
+	ssize_t len;
+
+	if (new && (fd = open(file, O_RDONLY)) < 0)
+		return errno;
+	len = pread(fd, dst, size - 1, 0);
+	if (new)
+		close(fd);
+	if (len < 0)
+		return errno;
+	dst[len] = '\0';
+	return 0;
+}
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+#define NEAR(a, b) (fabsf((a) - (b)) < 0.001f)
+
+static char root[] = "/tmp/cgroup_load_test.XXXXXX";
+
+static void put_file(const char *name, const char *fmt, ...) {
+	char path[PATH_MAX];
+	va_list ap;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+	fclose(f);
+}
+
+static void make_dir(const char *name) {
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	mkdir(path, 0755);
+}
+
+/* rewritten in place: cpu.stat stays open between samples */
+static void write_usage(unsigned long long usec) {
+	put_file("sys/audio/cpu.stat", "usage_usec %llu\nuser_usec %llu\n"
+			"system_usec 0\n", usec, usec);
+}
+
+/* the audio thread's utime and the cpu it ran on last */
+static void write_thread(unsigned long long ticks, int cpu) {
+	put_file("proc/100/stat", "%d (jackd) S 1 %d %d 0 -1 4194560 0 0 0 0 "
+			"%llu 0 0 0 -11 0 2 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 -1 %d "
+			"0 0 0 0 0\n", AUDIO_TID, AUDIO_TID, AUDIO_TID, ticks, cpu);
+}
+
+int main(int argc, char **argv) {
+	char proc[PATH_MAX], sys[PATH_MAX], cmd[PATH_MAX + 16];
+
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(proc, sizeof(proc), "%s/proc", root);
+	snprintf(sys, sizeof(sys), "%s/sys", root);
+	procfs_root = proc;
+	cgroupfs_root = sys;
+	make_dir("proc");
+	make_dir("proc/100");
+	make_dir("sys");
+	make_dir("sys/audio");
+	put_file("sys/cgroup.controllers", "cpuset cpu io memory pids\n");
+	put_file("sys/audio/cpuset.cpus.effective", "0-1\n");
+	put_file("sys/audio/cgroup.threads", "%d\n", AUDIO_TID);
+	write_usage(0);
+	write_thread(0, 1);
+
+	/* the JACK server in the root cgroup: every thread, refused */
+	put_file("proc/100/cgroup", "0::/\n");
+	cgroup_arg = "auto";
+	CHECK(cgroup_load_open(AUDIO_TID) != 0);
+	CHECK(!cgroup_load_active());
+	put_file("proc/100/cgroup", "0::/audio\n");
+	CHECK(cgroup_load_open(AUDIO_TID) == 0);
+	CHECK(cgroup_load_active());
+
+	cgroup_arg = "audio";
+	CHECK(cgroup_load_open(0) == 0);
+	CHECK(cgroup_load_active());
+	CHECK(cgroup_cpu_load(1) < 0);
+
+	/* half of a 100ms tick, all of it on the cpu the thread ran on */
+	now_ns += 100000000;
+	write_usage(50000);
+	write_thread(1, 1);
+	cgroup_load_sample();
+	CHECK(NEAR(cgroup_cpu_load(0), 0));
+	CHECK(NEAR(cgroup_cpu_load(1), 0.5));
+
+	/* too soon to walk the threads again: the last split holds */
+	now_ns += 10000000;
+	write_usage(53000);
+	write_thread(2, 0);
+	cgroup_load_sample();
+	CHECK(NEAR(cgroup_cpu_load(0), 0));
+	CHECK(NEAR(cgroup_cpu_load(1), 0.3));
+
+	/* the next walk catches up with the tick since the last one */
+	now_ns += 100000000;
+	write_usage(93000);
+	cgroup_load_sample();
+	CHECK(NEAR(cgroup_cpu_load(0), 0.4));
+	CHECK(NEAR(cgroup_cpu_load(1), 0));
+
+	/* no tick went by for the thread: spread over the cpuset */
+	now_ns += 100000000;
+	write_usage(133000);
+	cgroup_load_sample();
+	CHECK(NEAR(cgroup_cpu_load(0), 0.2));
+	CHECK(NEAR(cgroup_cpu_load(1), 0.2));
+	CHECK(NEAR(cgroup_cpu_load(2), 0));
+
+	/* more than a cpu's worth is a saturated cpu, not more */
+	now_ns += 100000000;
+	write_usage(433000);
+	write_thread(4, 0);
+	cgroup_load_sample();
+	CHECK(NEAR(cgroup_cpu_load(0), 1));
+	CHECK(NEAR(cgroup_cpu_load(1), 0));
+
+	cgroup_load_close();
+	CHECK(!cgroup_load_active());
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+	if (system(cmd) != 0)
+		perror(cmd);
+
+	if (failures)
+		fprintf(stderr, "%d checks failed\n", failures);
+	return failures != 0;
+}